@@ -85,6 +85,7 @@ struct plugin_info {
    /**
     * Loads after the given plugins. (Optional dependency)
     * The plugin will be loaded after the optional plugins, regardless if they are available.
+    * Only orders plugins that load anyway, lazy plugins are not loaded because of it.
     * May be NULL, if no requires are needed.
     * Zero-terminated array of pointers to char arrays.
     */
@@ -100,8 +101,32 @@ struct plugin_info {
     * Zero-terminated array of pointers to char arrays.
     */
    const char **groups;
+
+   /**
+    * Plugin is not loaded on startup, but when another plugin requires or imports it.
+    * Lazy plugins may be loaded after the compositor is ready, so they should not rely on startup hooks.
+    */
+   bool lazy;
+
+   /**
+    * plugin_init may run on another thread, in parallel with other such plugins whose dependencies are initialized.
+    * It may only import plugins it requires or loads after, and call methods of the core "orbment" plugin.
+    * Hooks added from parallel init have no defined order with other plugins of the same priority.
+    */
+   bool parallel_init;
 };
 
+/**
+ * Version of struct plugin_info in this header, bumped when fields are appended.
+ * Plugins export it once with PLUGIN_INFO_VERSION_EXPORT, next to plugin_register,
+ * so orbment never reads fields an older plugin does not have.
+ * Plugins without the export are version 1, their info ends at groups.
+ */
+#define PLUGIN_INFO_VERSION 2
+#define PLUGIN_INFO_VERSION_EXPORT const uint32_t plugin_info_version = PLUGIN_INFO_VERSION
+
+extern const uint32_t plugin_info_version;
+
 /**
  * Plugin handle.
  */
@@ -109,18 +134,75 @@ typedef size_t plugin_h;
 
 /**
  * Type of log message.
+ * DEBUG and TRACE are hidden by default, see plog.
  */
 enum plugin_log_type {
    PLOG_INFO,
    PLOG_WARN,
    PLOG_ERROR,
+   PLOG_DEBUG,
+   PLOG_TRACE,
+};
+
+/**
+ * Log messages more verbose than this are compiled out.
+ * Define before including this header to override, 0 (errors) to 4 (trace).
+ */
+#ifndef PLOG_COMPILE_VERBOSITY
+#  ifdef NDEBUG
+#     define PLOG_COMPILE_VERBOSITY 3
+#  else
+#     define PLOG_COMPILE_VERBOSITY 4
+#  endif
+#endif
+
+/**
+ * Verbosity of log message type, 0 for errors to 4 for trace.
+ */
+static inline PCONST uint8_t
+plog_verbosity(enum plugin_log_type type)
+{
+   return (type == PLOG_ERROR ? 0 : type == PLOG_WARN ? 1 : type == PLOG_INFO ? 2 : type == PLOG_DEBUG ? 3 : 4);
+}
+
+/**
+ * Highest runtime verbosity any plugin has.
+ * Read by the plog macro, do not write.
+ */
+extern uint8_t plog_max_verbosity;
+
+/**
+ * Priorities for hooks added with the add_hook(h,c[],fun,i32) method of the core "orbment" plugin.
+ * Hooks with higher priority are called first, hooks with the same priority in the order they were added.
+ * add_hook(h,c[],fun) adds hooks with HOOK_PRIORITY_DEFAULT.
+ *
+ * Input hooks (keyboard.key, pointer.*, touch) stop propagation when a hook returns true,
+ * hooks that must see every input event should use HOOK_PRIORITY_MONITOR.
+ */
+enum hook_priority {
+   HOOK_PRIORITY_LOW = -100,
+   HOOK_PRIORITY_DEFAULT = 0,
+   HOOK_PRIORITY_HIGH = 100,
+   HOOK_PRIORITY_MONITOR = 200,
 };
 
 /**
  * Logging utility.
+ * Messages more verbose than the level of the plugin are not written.
+ * Level is read from the "/log/<plugin>/level" configuration key (error, warn, info, debug, trace), info by default.
  */
 PNONULLV(3) PLOG_ATTR(3, 4) void plog(plugin_h self, enum plugin_log_type, const char *fmt, ...);
 
+/**
+ * Arguments are only evaluated if some plugin logs at the verbosity of the message.
+ * Thus disabled DEBUG and TRACE logging costs a branch.
+ */
+#define plog(self, type, ...) \
+   do { \
+      if (plog_verbosity(type) <= PLOG_COMPILE_VERBOSITY && plog_verbosity(type) <= plog_max_verbosity) \
+         (plog)(self, type, __VA_ARGS__); \
+   } while (0)
+
 /**
  * Imports plugin with name.
  * Returns plugin handle, 0 if no such plugin.
@@ -200,7 +282,14 @@ PNONULL void* import_method(plugin_h self, plugin_h plugin, const char *name, co
 #define REGISTER_METHOD(fun, sig) { .info = { .name = #fun, .signature = sig }, .function = fun, .deprecated = false }
 
 /**
- * Same as above, but marks as deprecated.
+ * Same as REGISTER_METHOD, but exports the function under given name.
+ * Methods may be registered multiple times under the same name with different signatures,
+ * import_method picks the one matching the signature.
+ */
+#define REGISTER_METHOD_NAMED(n, fun, sig) { .info = { .name = n, .signature = sig }, .function = fun, .deprecated = false }
+
+/**
+ * Same as REGISTER_METHOD, but marks as deprecated.
  */
 #define REGISTER_DEPRECATED(fun, sig) { .info = { .name = #fun, .signature = sig }, .function = fun, .deprecated = true }
 
@@ -1,62 +1,303 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include <wlc/wlc.h>
 #include <orbment/plugin.h>
 #include <chck/string/string.h>
 #include <chck/pool/pool.h>
+#include <chck/math/math.h>
 #include "config.h"
-#include <wlc/wlc.h>
+
+/**
+ * Programs are launched from a timer, so a long autostart list does not delay the first frames.
+ *
+ * /autostart/N           command line of entry N
+ * /autostart/N/phase     "ready" to start on compositor.ready, "frame" (default) after the first frame
+ * /autostart/N/delay     milliseconds to wait after the phase began, or after the entry waited for was launched
+ * /autostart/N/after     index of entry that must be launched before this one
+ * /autostart/concurrency entries launched at most per scheduling step
+ */
+
+enum phase {
+   PHASE_READY,
+   PHASE_FRAME,
+   PHASE_LAST,
+};
+
+// Spacing of scheduling steps, when more entries are due than concurrency allows.
+static const uint32_t STEP_MS = 50;
+
+static const uint32_t DEFAULT_CONCURRENCY = 2;
+
+static const uint32_t NOENTRY = (uint32_t)-1;
+
+struct entry {
+   struct chck_string command;
+   // time of launch in milliseconds, 0 until launched
+   uint64_t launched;
+   uint32_t delay, after;
+   enum phase phase;
+};
 
 static bool (*configuration_get)(const char *key, const char type, void *value_out);
 static bool (*add_hook)(plugin_h, const char *name, const struct function*);
+static void (*remove_hook)(plugin_h, const char *name);
+static bool (*exec)(const char *file, char *const argv[]);
 
 static struct {
+   struct chck_iter_pool entries;
+   struct wlc_event_source *timer;
+
+   // time each phase began in milliseconds, 0 if it has not yet
+   uint64_t phases[PHASE_LAST];
+
+   uint32_t concurrency;
+   bool frame_hook;
    plugin_h self;
 } plugin;
 
+static uint64_t
+now_ms(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void
+entry_release(struct entry *entry)
+{
+   if (!entry)
+      return;
+
+   chck_string_release(&entry->command);
+}
+
 static void
-do_autostart(void)
+launch(struct entry *entry)
 {
-   struct chck_string key = {0}, command = {0};
+   struct chck_string command = {0};
    struct chck_iter_pool argv;
 
    if (!chck_iter_pool(&argv, 4, 4, sizeof(char*)))
       return;
 
+   // tokenizing replaces separators, keep the original for logging
+   if (!chck_string_set_cstr(&command, entry->command.data, true))
+      goto out;
+
+   char *t;
+   size_t len;
+   const char *state = NULL;
+   while ((t = (char*)chck_cstr_tokenize_quoted(command.data, &len, " ", "\"'", &state))) {
+      chck_iter_pool_push_back(&argv, &t);
+      t[len] = 0; /* replaces each token with \0 */
+   }
+
+   const char *null = NULL;
+   chck_iter_pool_push_back(&argv, &null); /* NULL indicates end of the array */
+   plog(plugin.self, PLOG_INFO, "spawning: %s", entry->command.data);
+   exec(command.data, chck_iter_pool_to_c_array(&argv, NULL));
+
+out:
+   chck_string_release(&command);
+   chck_iter_pool_release(&argv);
+}
+
+/** Returns false if entry can not be scheduled yet, otherwise out_at is the time it is due. */
+static bool
+due_at(const struct entry *entry, uint64_t *out_at)
+{
+   uint64_t base;
+   if (!(base = plugin.phases[entry->phase]))
+      return false;
+
+   if (entry->after != NOENTRY) {
+      const struct entry *dep = chck_iter_pool_get(&plugin.entries, entry->after);
+      if (!dep->launched)
+         return false;
+
+      base = chck_maxu64(base, dep->launched);
+   }
+
+   *out_at = base + entry->delay;
+   return true;
+}
+
+static void
+schedule(uint32_t ms)
+{
+   // zero would disarm the timer
+   wlc_event_source_timer_update(plugin.timer, chck_maxu32(ms, 1));
+}
+
+static int
+timer_cb_schedule(void *arg)
+{
+   (void)arg;
+
+   if (plugin.frame_hook && plugin.phases[PHASE_FRAME]) {
+      // Removing hook while it is being dispatched is not safe, so it is done here.
+      remove_hook(plugin.self, "output.post_render");
+      plugin.frame_hook = false;
+   }
+
+   const uint64_t time = now_ms();
+   uint64_t next = 0;
+   uint32_t launched = 0;
+
+   struct entry *e;
+   chck_iter_pool_for_each(&plugin.entries, e) {
+      uint64_t at;
+      if (e->launched || !due_at(e, &at))
+         continue;
+
+      if (at > time) {
+         next = (next ? chck_minu64(next, at) : at);
+         continue;
+      }
+
+      if (launched >= plugin.concurrency) {
+         next = (next ? chck_minu64(next, time + STEP_MS) : time + STEP_MS);
+         continue;
+      }
+
+      launch(e);
+      e->launched = time;
+      ++launched;
+   }
+
+   // Entries waiting for the ones just launched are seen on next step.
+   if (launched > 0)
+      next = (next ? chck_minu64(next, time + STEP_MS) : time + STEP_MS);
+
+   if (next)
+      schedule(next - time);
+
+   return 1;
+}
+
+static void
+begin_phase(enum phase phase)
+{
+   if (plugin.phases[phase])
+      return;
+
+   plugin.phases[phase] = now_ms();
+   schedule(0);
+}
+
+static void
+output_post_render(wlc_handle output)
+{
+   (void)output;
+   begin_phase(PHASE_FRAME);
+}
+
+/** Drops ordering constraints that refer to missing entries or form a cycle. */
+static void
+validate_entries(void)
+{
+   const size_t memb = plugin.entries.items.count;
+
+   // every reference is in range before any chain is walked
+   struct entry *e;
+   chck_iter_pool_for_each(&plugin.entries, e) {
+      if (e->after == NOENTRY || e->after < memb)
+         continue;
+
+      plog(plugin.self, PLOG_WARN, "/autostart/%zu/after refers to missing entry %u", _I - 1, e->after);
+      e->after = NOENTRY;
+   }
+
+   chck_iter_pool_for_each(&plugin.entries, e) {
+      if (e->after == NOENTRY)
+         continue;
+
+      // chain longer than there are entries loops
+      size_t steps = 0;
+      for (uint32_t i = e->after; i != NOENTRY && steps <= memb; ++steps)
+         i = ((struct entry*)chck_iter_pool_get(&plugin.entries, i))->after;
+
+      if (steps > memb) {
+         plog(plugin.self, PLOG_WARN, "/autostart/%zu/after forms a cycle, ignoring it", _I - 1);
+         e->after = NOENTRY;
+      }
+   }
+}
+
+static bool
+load_entries(void)
+{
+   struct chck_string key = {0};
+
    for (uint32_t i = 0; ; i++) {
-      if (!chck_string_set_format(&key, "/autostart/%u", i))
+      const char *command;
+      if (!chck_string_set_format(&key, "/autostart/%u", i) || !configuration_get(key.data, 's', &command))
          break;
 
-      const char *command_cstr;
-      if (!configuration_get(key.data, 's', &command_cstr))
-         break;
+      struct entry entry = {
+         .after = NOENTRY,
+         .phase = PHASE_FRAME,
+      };
 
-      if (!chck_string_set_cstr(&command, command_cstr, true))
-         break;
+      if (chck_string_set_format(&key, "/autostart/%u/delay", i))
+         configuration_get(key.data, 'u', &entry.delay);
+
+      if (chck_string_set_format(&key, "/autostart/%u/after", i))
+         configuration_get(key.data, 'u', &entry.after);
 
-      char *t;
-      size_t len;
-      const char *state = NULL;
-      while ((t = (char*)chck_cstr_tokenize_quoted(command.data, &len, " ", "\"'", &state))) {
-         chck_iter_pool_push_back(&argv, &t);
-         t[len] = 0; /* replaces each token with \0 */
+      const char *phase;
+      if (chck_string_set_format(&key, "/autostart/%u/phase", i) && configuration_get(key.data, 's', &phase)) {
+         if (chck_cstreq(phase, "ready")) {
+            entry.phase = PHASE_READY;
+         } else if (!chck_cstreq(phase, "frame")) {
+            plog(plugin.self, PLOG_WARN, "%s: unknown phase '%s', using 'frame'", key.data, phase);
+         }
       }
 
-      const char *null = NULL;
-      chck_iter_pool_push_back(&argv, &null); /* NULL indicates end of the array */
-      plog(plugin.self, PLOG_INFO, "spawning: %s", command_cstr);
-      wlc_exec(command.data, chck_iter_pool_to_c_array(&argv, NULL));
-      chck_iter_pool_empty(&argv);
+      if (!chck_string_set_cstr(&entry.command, command, true) || !chck_iter_pool_push_back(&plugin.entries, &entry)) {
+         entry_release(&entry);
+         goto error;
+      }
    }
 
+   if (!configuration_get("/autostart/concurrency", 'u', &plugin.concurrency) || plugin.concurrency == 0)
+      plugin.concurrency = DEFAULT_CONCURRENCY;
+
    chck_string_release(&key);
-   chck_string_release(&command);
-   chck_iter_pool_release(&argv);
+   validate_entries();
+   return true;
+
+error:
+   chck_string_release(&key);
+   return false;
+}
+
+static void
+compositor_ready(void)
+{
+   if (!load_entries())
+      plog(plugin.self, PLOG_ERROR, "Could not load autostart entries");
+
+   begin_phase(PHASE_READY);
 }
 
 #pragma GCC diagnostic ignored "-Wmissing-prototypes"
 
+void
+plugin_deinit(plugin_h self)
+{
+   (void)self;
+
+   if (plugin.timer)
+      wlc_event_source_remove(plugin.timer);
+
+   chck_iter_pool_for_each_call(&plugin.entries, entry_release);
+   chck_iter_pool_release(&plugin.entries);
+}
+
 bool
 plugin_init(plugin_h self)
 {
@@ -68,12 +309,24 @@ plugin_init(plugin_h self)
       return false;
 
    if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun)|1")) ||
+       !(remove_hook = import_method(self, orbment, "remove_hook", "v(h,c[])|1")) ||
+       !(exec = import_method(self, orbment, "exec", "b(c[],c*[])|1")) ||
        !(configuration_get = import_method(self, configuration, "get", "b(c[],c,v)|1")))
       return false;
 
-   return add_hook(self, "compositor.ready", FUN(do_autostart, "v(v)|1"));
+   if (!chck_iter_pool(&plugin.entries, 8, 0, sizeof(struct entry)))
+      return false;
+
+   if (!(plugin.timer = wlc_event_loop_add_timer(timer_cb_schedule, NULL)))
+      return false;
+
+   plugin.frame_hook = true;
+   return (add_hook(self, "compositor.ready", FUN(compositor_ready, "v(v)|1")) &&
+           add_hook(self, "output.post_render", FUN(output_post_render, "v(h)|1")));
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
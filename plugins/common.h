@@ -6,6 +6,8 @@
 // XXX: hack
 enum {
    BIT_BEMENU = 1<<5,
+   BIT_FLOATING = 1<<6, // never tiled, see the rules plugin
+   BIT_NOFOCUS = 1<<7, // not focused when created
 };
 
 enum direction {
@@ -13,6 +15,57 @@ enum direction {
    PREV,
 };
 
+/**
+ * Per-view input given to layout functions.
+ * min is the smallest size the view may be given, 0x0 when unknown.
+ * active is set for the activated view, layouts that show only it may leave the other views
+ * zero sized, they are then configured only once they get activated.
+ */
+struct layout_hint {
+   struct wlc_geometry current;
+   struct wlc_size min;
+   bool active;
+};
+
+/**
+ * View properties mirrored by the view-cache plugin.
+ * Predicates taking view_info read no wlc state, parent included.
+ */
+struct view_info {
+   wlc_handle output, parent;
+   uint32_t type, state, mask;
+};
+
+static inline bool
+info_is_or(const struct view_info *info)
+{
+   return (info->type & WLC_BIT_OVERRIDE_REDIRECT) || (info->type & BIT_BEMENU);
+}
+
+static inline bool
+info_is_popup(const struct view_info *info)
+{
+   return (info->type & WLC_BIT_POPUP);
+}
+
+static inline bool
+info_is_managed(const struct view_info *info)
+{
+   return !(info->type & WLC_BIT_UNMANAGED) && !(info->type & WLC_BIT_SPLASH);
+}
+
+static inline bool
+info_is_modal(const struct view_info *info)
+{
+   return (info->type & WLC_BIT_MODAL);
+}
+
+static inline bool
+info_is_tiled(const struct view_info *info)
+{
+   return !(info->state & WLC_BIT_FULLSCREEN) && !(info->type & BIT_FLOATING) && !info->parent && info_is_managed(info) && !info_is_or(info) && !info_is_modal(info) && !info_is_popup(info);
+}
+
 static inline bool
 is_or(wlc_handle view)
 {
@@ -45,7 +98,7 @@ static inline bool
 is_tiled(wlc_handle view)
 {
    const uint32_t state = wlc_view_get_state(view);
-   return !(state & WLC_BIT_FULLSCREEN) && !wlc_view_get_parent(view) && is_managed(view) && !is_or(view) && !is_modal(view) && !is_popup(view);
+   return !(state & WLC_BIT_FULLSCREEN) && !(wlc_view_get_type(view) & BIT_FLOATING) && !wlc_view_get_parent(view) && is_managed(view) && !is_or(view) && !is_modal(view) && !is_popup(view);
 }
 
 #endif /* __orbment_common_h__ */
@@ -78,6 +78,8 @@ plugin_init(plugin_h self)
    return add_compressor(self, "image", "ppm", "ppm", FUN(compress_ppm, "u8[](p,u8[],sz*)|1"));
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
@@ -97,6 +99,7 @@ plugin_register(void)
       .version = VERSION,
       .requires = requires,
       .groups = groups,
+      .lazy = true,
    };
 
    return &info;
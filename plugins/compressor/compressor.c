@@ -203,6 +203,8 @@ plugin_init(plugin_h self)
    return (add_hook(self, "plugin.deloaded", FUN(plugin_deloaded, "v(h)|1")));
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
@@ -224,6 +226,7 @@ plugin_register(void)
       .version = VERSION,
       .methods = methods,
       .groups = groups,
+      .lazy = true,
    };
 
    return &info;
@@ -5,6 +5,8 @@
 #include "config.h"
 
 static bool (*add_hook)(plugin_h, const char *name, const struct function*);
+static bool (*set_log_level)(const char *name, const char *level);
+static bool (*set_plugin_enabled)(const char *name, bool enable);
 
 static const char *load_sig = "*(c[],sz*)|1";
 static const char *save_sig = "b(c[],*,sz)|1";
@@ -65,6 +67,49 @@ free_ptr(void **ptr)
    free((ptr ? *ptr : NULL));
 }
 
+static bool
+plugin_from_key(const char *key, const char *prefix, const char *suffix, struct chck_string *out_name)
+{
+   assert(key && prefix && suffix && out_name);
+
+   /* <prefix><plugin><suffix> */
+   const size_t len = strlen(key), plen = strlen(prefix), slen = strlen(suffix);
+
+   if (len <= plen + slen ||
+       !chck_cstrneq(key, prefix, plen) ||
+       !chck_cstreq(key + len - slen, suffix))
+      return false;
+
+   if (!chck_string_set_cstr_with_length(out_name, key + plen, len - plen - slen, true))
+      return false;
+
+   if (strchr(out_name->data, '/')) {
+      chck_string_release(out_name);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+apply_plugin_key(const char *key, const char *value)
+{
+   assert(key && value);
+
+   struct chck_string name = {0};
+   if (plugin_from_key(key, "/log/", "/level", &name)) {
+      set_log_level(name.data, value);
+   } else if (plugin_from_key(key, "/plugins/", "/enabled", &name)) {
+      bool enable;
+      if (chck_cstr_to_bool(value, &enable))
+         set_plugin_enabled(name.data, enable);
+      else
+         plog(plugin.self, PLOG_WARN, "%s: expected boolean, got '%s'", key, value);
+   }
+
+   chck_string_release(&name);
+}
+
 static void
 load_config(void)
 {
@@ -90,7 +135,8 @@ load_config(void)
          continue;
       }
 
-      plog(plugin.self, PLOG_INFO, "%s = %s", pairs[i].key, pairs[i].value);
+      plog(plugin.self, PLOG_DEBUG, "%s = %s", pairs[i].key, pairs[i].value);
+      apply_plugin_key(pairs[i].key, pairs[i].value);
       chck_hash_table_str_set(&plugin.table, pairs[i].key, strlen(pairs[i].key), &pairs[i].value);
       free(pairs[i].key);
    }
@@ -212,9 +258,15 @@ plugin_init(plugin_h self)
    if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun)|1")))
       return false;
 
+   if (!(set_log_level = import_method(self, orbment, "set_log_level", "b(c[],c[])|1")) ||
+       !(set_plugin_enabled = import_method(self, orbment, "set_plugin_enabled", "b(c[],b)|1")))
+      return false;
+
    return (add_hook(self, "plugin.deloaded", FUN(plugin_deloaded, "v(h)|1")));
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
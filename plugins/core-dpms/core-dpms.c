@@ -7,7 +7,7 @@
 
 typedef void (*keybind_fun_t)(wlc_handle view, uint32_t time, intptr_t arg);
 static bool (*add_keybind)(plugin_h, const char *name, const char **syntax, const struct function*, intptr_t arg);
-static bool (*add_hook)(plugin_h, const char *name, const struct function*);
+static bool (*add_hook)(plugin_h, const char *name, const struct function*, int32_t priority);
 
 static struct {
    struct {
@@ -178,7 +178,7 @@ plugin_init(plugin_h self)
        !(keybind = import_plugin(self, "keybind")))
       return false;
 
-   if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun)|1")) ||
+   if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun,i32)|1")) ||
        !(add_keybind = import_method(self, keybind, "add_keybind", "b(h,c[],c*[],fun,ip)|1")))
       return false;
 
@@ -186,17 +186,20 @@ plugin_init(plugin_h self)
       if (!add_keybind(self, keybinds[i].name, keybinds[i].syntax, FUN(keybinds[i].function, "v(h,u32,ip)|1"), keybinds[i].arg))
          return false;
 
-   if (!add_hook(self, "keyboard.key", FUN(keyboard_key, "b(h,u32,*,u32,e)|1")) ||
-       !add_hook(self, "pointer.button", FUN(pointer_button, "b(h,u32,*,u32,e,*)|1")) ||
-       !add_hook(self, "pointer.scroll", FUN(activity, "b(h,u32,*,u8,d[2])|1")) ||
-       !add_hook(self, "pointer.motion", FUN(activity, "b(h,u32,*)|1")) ||
-       !add_hook(self, "touch", FUN(activity, "b(h,u32,*,e,i32,*)|1")))
+   // Activity must be seen before any other hook gets to consume the input.
+   if (!add_hook(self, "keyboard.key", FUN(keyboard_key, "b(h,u32,*,u32,e)|1"), HOOK_PRIORITY_MONITOR) ||
+       !add_hook(self, "pointer.button", FUN(pointer_button, "b(h,u32,*,u32,e,*)|1"), HOOK_PRIORITY_MONITOR) ||
+       !add_hook(self, "pointer.scroll", FUN(activity, "b(h,u32,*,u8,d[2])|1"), HOOK_PRIORITY_MONITOR) ||
+       !add_hook(self, "pointer.motion", FUN(activity, "b(h,u32,*)|1"), HOOK_PRIORITY_MONITOR) ||
+       !add_hook(self, "touch", FUN(activity, "b(h,u32,*,e,i32,*)|1"), HOOK_PRIORITY_MONITOR))
       return false;
 
    load_config(self);
    return wlc_event_source_timer_update(plugin.timers.sleep, 1000 * plugin.config.delay);
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
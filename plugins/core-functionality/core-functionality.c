@@ -1,8 +1,9 @@
 #include <unistd.h>
 #include <stdlib.h>
-#include <limits.h>
 #include <orbment/plugin.h>
 #include <chck/math/math.h>
+#include <chck/pool/pool.h>
+#include <chck/lut/lut.h>
 #include <chck/string/string.h>
 #include "common.h"
 #include "config.h"
@@ -10,23 +11,88 @@
 #define DEFAULT_TERMINAL "weston-terminal"
 #define DEFAULT_MENU "bemenu-run"
 
+// Frames to wait for a client to commit a requested size, before sending the next one anyway.
+static const uint32_t CONFIGURE_TIMEOUT_FRAMES = 4;
+
 static void (*relayout)(wlc_handle output);
+static void (*update_view)(wlc_handle view);
+
+static bool (*get_view)(wlc_handle view, struct view_info *out_info);
+static void (*set_state)(wlc_handle view, enum wlc_view_state_bit state, bool toggle);
+static void (*set_type)(wlc_handle view, uint32_t type, bool toggle);
+static void (*set_output)(wlc_handle view, wlc_handle output);
+static void (*set_parent)(wlc_handle view, wlc_handle parent);
+static const wlc_handle* (*get_children)(wlc_handle view, size_t *out_memb);
+static void (*bring_to_front)(wlc_handle view);
+static wlc_handle (*get_fullscreen)(wlc_handle output);
+
+static void (*spaces_focus_space)(wlc_handle output, uint32_t index);
+static const wlc_handle* (*get_space_views)(wlc_handle output, uint32_t index, size_t *out_memb);
+static void (*spaces_move_to_space)(wlc_handle view, uint32_t index);
+static uint32_t (*get_space)(wlc_handle view);
+static uint32_t (*get_active_space)(wlc_handle output);
+static uint32_t (*get_space_count)(wlc_handle output);
+
+// Focus history of one output and space, a list of views linked through their history entries.
+struct history {
+   wlc_handle newest;
+   wlc_handle output;
+   uint32_t space;
+};
+
+// Place of view in the focus history it belongs to.
+struct history_entry {
+   wlc_handle newer, older;
+   wlc_handle output;
+   uint32_t space;
+   bool valid;
+};
 
 typedef void (*keybind_fun_t)(wlc_handle view, uint32_t time, intptr_t arg);
 static bool (*add_keybind)(plugin_h, const char *name, const char **syntax, const struct function*, intptr_t arg);
-static bool (*add_hook)(plugin_h, const char *name, const struct function*);
+static bool (*add_hook)(plugin_h, const char *name, const struct function*, int32_t priority);
+static bool (*exec)(const char *file, char *const argv[]);
 
 static struct {
    struct {
       wlc_handle view;
-      struct wlc_point grab;
+      struct wlc_point grab, pointer;
       uint32_t edges;
+
+      // Pointer moved since the geometry was last applied, see output_pre_render.
+      bool dirty;
+
+      struct {
+         struct wlc_size size, from;
+         uint32_t frames;
+         bool pending;
+      } configure;
    } action;
 
    struct {
       wlc_handle view;
    } active;
 
+   // latest bemenu view, see view_created
+   wlc_handle bemenu;
+
+   struct {
+      // outputs * used spaces is small, linear search is fine.
+      struct chck_iter_pool histories;
+
+      // view -> struct history_entry, so touching and removing a view is constant time
+      struct chck_hash_table entries;
+
+      struct {
+         // Cycling through history does not reorder it until the cycle ends,
+         // view that was cycled to is then moved on top.
+         // cursor is the history entry cycled to, each step follows its older link.
+         struct wlc_event_source *timer;
+         wlc_handle view, cursor;
+         bool focusing;
+      } cycle;
+   } focus;
+
    struct {
       bool follow_focus;
    } config;
@@ -42,8 +108,8 @@ start_interactive_action(wlc_handle view, const struct wlc_point *origin)
       return false;
 
    plugin.action.view = view;
-   plugin.action.grab = *origin;
-   wlc_view_bring_to_front(view);
+   plugin.action.grab = plugin.action.pointer = *origin;
+   bring_to_front(view);
    return true;
 }
 
@@ -68,56 +134,109 @@ start_interactive_resize(wlc_handle view, uint32_t edges, const struct wlc_point
                             (origin->y < halfh ? WLC_RESIZE_EDGE_TOP : (origin->y > halfh ? WLC_RESIZE_EDGE_BOTTOM : 0));
    }
 
-   wlc_view_set_state(view, WLC_BIT_RESIZING, true);
+   set_state(view, WLC_BIT_RESIZING, true);
 }
 
-static void
-stop_interactive_action(void)
+static inline bool
+size_eq(const struct wlc_size *a, const struct wlc_size *b)
 {
-   if (!plugin.action.view)
-      return;
-
-   wlc_view_set_state(plugin.action.view, WLC_BIT_RESIZING, false);
-   memset(&plugin.action, 0, sizeof(plugin.action));
+   assert(a && b);
+   return (a->w == b->w && a->h == b->h);
 }
 
-static wlc_handle
-get_next_view(wlc_handle view, size_t offset, enum direction dir)
+static bool
+configure_acked(void)
 {
-   size_t memb, i;
-   wlc_handle *views = wlc_output_get_mutable_views((view ? wlc_view_get_output(view) : wlc_get_focused_output()), &memb);
-   for (i = 0; i < memb && views[i] != view; ++i);
-   return (memb > 0 ? views[(dir == PREV ? chck_clampsz(i - offset, 0, memb - 1) : i + offset) % memb] : 0);
+   if (!plugin.action.configure.pending)
+      return true;
+
+   // Clients may round the size (terminals to cells), so any commit of new size counts.
+   struct wlc_geometry v;
+   wlc_view_get_visible_geometry(plugin.action.view, &v);
+   const bool committed = (!size_eq(&v.size, &plugin.action.configure.from) || size_eq(&v.size, &plugin.action.configure.size));
+
+   if (committed || ++plugin.action.configure.frames > CONFIGURE_TIMEOUT_FRAMES)
+      plugin.action.configure.pending = false;
+
+   return !plugin.action.configure.pending;
 }
 
-PPURE static uint32_t
-rotate_mask(uint32_t mask, size_t offset, enum direction dir)
+/**
+ * Applies the latest pointer position to the view being moved or resized.
+ * Resizes are held back until the client has committed the previously requested size, unless forced.
+ */
+static void
+apply_interactive_action(bool force)
 {
-   // Shifting with the total bits or more of mask variable causes UB
-   assert(sizeof(mask) * CHAR_BIT >= offset);
+   if (!plugin.action.view || !plugin.action.dirty)
+      return;
+
+   if (plugin.action.edges && !configure_acked() && !force)
+      return;
+
+   const struct wlc_point *pointer = &plugin.action.pointer;
+   const int32_t dx = pointer->x - plugin.action.grab.x;
+   const int32_t dy = pointer->y - plugin.action.grab.y;
+   struct wlc_geometry g = *wlc_view_get_geometry(plugin.action.view);
 
-   // XXX: Hardcoded to rotate range of 10 spaces.
-   //      Not yet sure how Orbment space handling eventually works.
-   //      But right now this is convenient due to Orbment giving you keybindings to 10 spaces.
-   const uint32_t range = 10;
+   if (plugin.action.edges) {
+      const struct wlc_size min = { 80, 40 };
 
-   // Circular shift from https://en.wikipedia.org/wiki/Circular_shift
-   // Modified to shift only a subsection of the bits
+      struct wlc_geometry n = g;
+      if (plugin.action.edges & WLC_RESIZE_EDGE_LEFT) {
+         n.size.w -= dx;
+         n.origin.x += dx;
+      } else if (plugin.action.edges & WLC_RESIZE_EDGE_RIGHT) {
+         n.size.w += dx;
+      }
+
+      if (plugin.action.edges & WLC_RESIZE_EDGE_TOP) {
+         n.size.h -= dy;
+         n.origin.y += dy;
+      } else if (plugin.action.edges & WLC_RESIZE_EDGE_BOTTOM) {
+         n.size.h += dy;
+      }
 
-   // Bitmask for the spaces in range, toggled bits define the spaces to shift, untoggled bits are left alone
-   const uint32_t whitemask = (uint32_t)((uint64_t)1 << range) - 1;
+      if (n.size.w >= min.w) {
+         g.origin.x = n.origin.x;
+         g.size.w = n.size.w;
+      }
 
-   // Take the spaces in range and bitrotate them while ignoring spaces outside of the range
-   const uint32_t spaces = mask & whitemask;
+      if (n.size.h >= min.h) {
+         g.origin.y = n.origin.y;
+         g.size.h = n.size.h;
+      }
 
-   uint32_t newmask;
-   if (PREV == dir)
-      newmask = (spaces >> offset) | (spaces << (range - offset));
-   else
-      newmask = (spaces << offset) | (spaces >> (range - offset));
+      if (!size_eq(&g.size, &wlc_view_get_geometry(plugin.action.view)->size)) {
+         struct wlc_geometry v;
+         wlc_view_get_visible_geometry(plugin.action.view, &v);
+         plugin.action.configure.size = g.size;
+         plugin.action.configure.from = v.size;
+         plugin.action.configure.frames = 0;
+         plugin.action.configure.pending = true;
+      }
 
-   // Truncate bitmask to the range and append the bits outside of the range.
-   return (newmask & whitemask) | (~whitemask & mask);
+      wlc_view_set_geometry(plugin.action.view, plugin.action.edges, &g);
+   } else {
+      g.origin.x += dx;
+      g.origin.y += dy;
+      wlc_view_set_geometry(plugin.action.view, 0, &g);
+   }
+
+   plugin.action.grab = *pointer;
+   plugin.action.dirty = false;
+}
+
+static void
+stop_interactive_action(void)
+{
+   if (!plugin.action.view)
+      return;
+
+   // Do not lose the motion since last frame
+   apply_interactive_action(true);
+   set_state(plugin.action.view, WLC_BIT_RESIZING, false);
+   memset(&plugin.action, 0, sizeof(plugin.action));
 }
 
 static wlc_handle
@@ -129,13 +248,21 @@ get_next_output(wlc_handle output, size_t offset, enum direction dir)
    return (memb > 0 ? outputs[(dir == PREV ? chck_clampsz(i - offset, 0, memb - 1) : i + offset) % memb] : 0);
 }
 
+static bool
+is_on_space(wlc_handle view, uint32_t space)
+{
+   return (get_space(view) == space);
+}
+
 static bool
 should_focus_on_create(wlc_handle view)
 {
    // Do not allow unmanaged views to steal focus (tooltips, dnds, etc..)
    // Do not allow parented windows to steal focus, if current window wasn't parent.
+   // Do not focus views a rule told not to, or sent to a space that is not shown.
    const wlc_handle parent = wlc_view_get_parent(view);
-   return (is_managed(view) && (!plugin.active.view || !parent || parent == plugin.active.view));
+   return (is_managed(view) && !(wlc_view_get_type(view) & BIT_NOFOCUS) && (!plugin.active.view || !parent || parent == plugin.active.view) &&
+           is_on_space(view, get_active_space(wlc_view_get_output(view))));
 }
 
 static void
@@ -147,21 +274,20 @@ raise_all(wlc_handle view)
       return;
 
    // Raise view and all related views to top honoring the stacking order.
-   wlc_handle parent;
-   if ((parent = wlc_view_get_parent(view))) {
-      raise_all(parent);
+   struct view_info info;
+   if (get_view(view, &info) && info.parent) {
+      raise_all(info.parent);
 
+      // siblings are in stacking order, raising them in order keeps it
       size_t memb;
-      const wlc_handle *views = wlc_output_get_views(wlc_view_get_output(view), &memb);
+      const wlc_handle *siblings = get_children(info.parent, &memb);
       for (size_t i = 0; i < memb; ++i) {
-         if (views[i] == view || wlc_view_get_parent(views[i]) != parent)
-            continue;
-
-         wlc_view_bring_to_front(views[i]);
+         if (siblings[i] != view)
+            bring_to_front(siblings[i]);
       }
    }
 
-   wlc_view_bring_to_front(view);
+   bring_to_front(view);
 }
 
 static void
@@ -175,53 +301,37 @@ focus_view(wlc_handle view)
 
    // Bemenu should always have focus when open.
    if (plugin.active.view && (wlc_view_get_type(plugin.active.view) & BIT_BEMENU)) {
-      wlc_view_bring_to_front(plugin.active.view);
+      bring_to_front(plugin.active.view);
       return;
    }
 
    if (view) {
       {
          size_t memb;
-         const wlc_handle *views = wlc_output_get_views(wlc_view_get_output(view), &memb);
-         for (size_t i = memb; i > 0; --i) {
-            if (wlc_view_get_parent(views[i - 1]) == view) {
-               // If window has parent, focus it instead of this.
-               // By reverse searching views list, we get the topmost parent.
-               focus_view(views[i - 1]);
-               return;
-            }
+         const wlc_handle *children = get_children(view, &memb);
+         if (memb > 0) {
+            // If window has children, focus the topmost one instead of this.
+            focus_view(children[memb - 1]);
+            return;
          }
       }
 
       // Only raise fullscreen views when focused view is managed
       if (is_managed(view) && !is_or(view)) {
-         size_t memb;
-         const wlc_handle *views = wlc_output_get_views(wlc_view_get_output(view), &memb);
-         for (size_t i = memb; i > 0; --i) {
-            if (wlc_view_get_state(views[i - 1]) & WLC_BIT_FULLSCREEN) {
-               // Bring the first topmost found fullscreen wlc_view to front.
-               // This way we get a "peek" effect when we cycle other views.
-               // Meaning the active view is always over fullscreen view,
-               // but fullscreen view is on top of the other views.
-               wlc_view_bring_to_front(views[i - 1]);
-               break;
-            }
-         }
+         // Bring the topmost fullscreen wlc_view to front.
+         // This way we get a "peek" effect when we cycle other views.
+         // Meaning the active view is always over fullscreen view,
+         // but fullscreen view is on top of the other views.
+         wlc_handle fullscreen;
+         if ((fullscreen = get_fullscreen(wlc_view_get_output(view))))
+            bring_to_front(fullscreen);
       }
 
       raise_all(view);
 
-      {
-         size_t memb;
-         const wlc_handle *views = wlc_output_get_views(wlc_view_get_output(view), &memb);
-         for (size_t i = memb; i > 0; --i) {
-            if ((wlc_view_get_type(views[i - 1]) & BIT_BEMENU)) {
-               // Always bring bemenu to front when exists.
-               wlc_view_bring_to_front(views[i - 1]);
-               break;
-            }
-         }
-      }
+      // Always bring bemenu to front when exists.
+      if (plugin.bemenu)
+         bring_to_front(plugin.bemenu);
    }
 
    wlc_view_focus(view);
@@ -231,49 +341,230 @@ focus_view(wlc_handle view)
 static void
 focus_next_or_previous_view(wlc_handle view, enum direction direction)
 {
-   wlc_handle first = get_next_view(view, 0, direction), v = first, old = plugin.active.view;
+   size_t memb, i;
+   const wlc_handle output = (view ? wlc_view_get_output(view) : wlc_get_focused_output());
+   const wlc_handle *views = get_space_views(output, get_active_space(output), &memb);
+   for (i = 0; i < memb && views[i] != view; ++i);
 
-   if (!first)
+   if (memb == 0)
       return;
 
-   do {
-      while ((v = get_next_view(v, 1, direction)) && v != first && wlc_view_get_mask(v) != wlc_output_get_mask(wlc_view_get_output(view)));
-      if (wlc_view_get_mask(v) == wlc_output_get_mask(wlc_get_focused_output()))
-         focus_view(v);
-   } while (plugin.active.view && plugin.active.view == old && v != old);
+   // Without view, walk all views starting from the first (or last) one.
+   const bool found = (i < memb);
+   if (!found)
+      i = (direction == NEXT ? memb - 1 : 0);
+
+   const wlc_handle old = plugin.active.view;
+   for (size_t n = 1, count = (found ? memb - 1 : memb); n <= count; ++n) {
+      const wlc_handle v = views[(direction == NEXT ? i + n : i + memb - n) % memb];
+
+      // Focusing restacks views, stop once something got focus.
+      focus_view(v);
+      if (plugin.active.view != old)
+         return;
+   }
+}
+
+static struct history*
+history_for(wlc_handle output, uint32_t space, bool create)
+{
+   struct history *h;
+   chck_iter_pool_for_each(&plugin.focus.histories, h) {
+      if (h->output == output && h->space == space)
+         return h;
+   }
+
+   if (!create)
+      return NULL;
+
+   if (!plugin.focus.histories.items.member && !chck_iter_pool(&plugin.focus.histories, 4, 0, sizeof(struct history)))
+      return NULL;
+
+   struct history history = {
+      .output = output,
+      .space = space,
+   };
+
+   return chck_iter_pool_push_back(&plugin.focus.histories, &history);
+}
+
+static struct history_entry*
+history_entry_for(wlc_handle view)
+{
+   struct history_entry *e;
+   if (!view || !plugin.focus.entries.lut.table || !(e = chck_hash_table_str_get(&plugin.focus.entries, (const char*)&view, sizeof(view))) || !e->valid)
+      return NULL;
+
+   return e;
 }
 
 static void
-focus_topmost(wlc_handle output)
+history_remove(wlc_handle view)
 {
-   size_t memb;
-   const wlc_handle *views = wlc_output_get_views(output, &memb);
-   for (size_t i = memb; i > 0; --i) {
-      if (wlc_view_get_mask(views[i - 1]) != wlc_output_get_mask(output))
-         continue;
+   struct history_entry *e;
+   if (!(e = history_entry_for(view)))
+      return;
 
-      focus_view(views[i - 1]);
+   const struct history_entry entry = *e;
+   e->valid = false;
+
+   struct history_entry *n;
+   if (entry.older && (n = history_entry_for(entry.older)))
+      n->newer = entry.newer;
+
+   if (entry.newer) {
+      if ((n = history_entry_for(entry.newer)))
+         n->older = entry.older;
+   } else {
+      struct history *h;
+      if ((h = history_for(entry.output, entry.space, false)))
+         h->newest = entry.older;
+   }
+}
+
+static void
+history_touch(wlc_handle view)
+{
+   history_remove(view);
+
+   struct view_info info;
+   struct history *h;
+   if (!get_view(view, &info) || !info.output || !(h = history_for(info.output, get_space(view), true)))
       return;
+
+   const struct history_entry entry = {
+      .older = h->newest,
+      .output = h->output,
+      .space = h->space,
+      .valid = true,
+   };
+
+   if (!chck_hash_table_str_set(&plugin.focus.entries, (const char*)&view, sizeof(view), &entry))
+      return;
+
+   struct history_entry *o;
+   if ((o = history_entry_for(h->newest)))
+      o->newer = view;
+
+   h->newest = view;
+}
+
+/**
+ * Returns view focused before newer on output and space, or the most recent one when newer is 0.
+ * Views that moved elsewhere are dropped on the way.
+ */
+static wlc_handle
+recent_view(wlc_handle output, uint32_t space, wlc_handle newer)
+{
+   wlc_handle v;
+   if (newer) {
+      const struct history_entry *n;
+      if (!(n = history_entry_for(newer)))
+         return 0;
+
+      v = n->older;
+   } else {
+      const struct history *h;
+      if (!(h = history_for(output, space, false)))
+         return 0;
+
+      v = h->newest;
+   }
+
+   const struct history_entry *e;
+   while ((e = history_entry_for(v))) {
+      const wlc_handle older = e->older;
+
+      struct view_info info;
+      if (get_view(v, &info) && info.output == output && get_space(v) == space)
+         return v;
+
+      history_remove(v);
+      v = older;
    }
 
-   // There is no topmost
-   focus_view(0);
+   return 0;
+}
+
+static void
+end_cycle(void)
+{
+   if (plugin.focus.cycle.view)
+      history_touch(plugin.focus.cycle.view);
+
+   plugin.focus.cycle.view = 0;
+   plugin.focus.cycle.cursor = 0;
+}
+
+static int
+timer_cb_cycle(void *arg)
+{
+   (void)arg;
+   end_cycle();
+   return 1;
+}
+
+static void
+cycle_recent(wlc_handle output)
+{
+   const uint32_t space = get_active_space(output);
+
+   // Cursor that left this history (destroyed, moved or other output) starts the cycle over.
+   const struct history_entry *e;
+   if (plugin.focus.cycle.cursor &&
+       (!(e = history_entry_for(plugin.focus.cycle.cursor)) || e->output != output || e->space != space))
+      end_cycle();
+
+   const wlc_handle from = (plugin.focus.cycle.cursor ? plugin.focus.cycle.cursor : recent_view(output, space, 0));
+
+   wlc_handle view;
+   if (!from || (!(view = recent_view(output, space, from)) && !(view = recent_view(output, space, 0))))
+      return;
+
+   plugin.focus.cycle.focusing = true;
+   focus_view(view);
+   plugin.focus.cycle.focusing = false;
+
+   plugin.focus.cycle.view = plugin.active.view;
+   plugin.focus.cycle.cursor = view;
+   wlc_event_source_timer_update(plugin.focus.cycle.timer, 1000);
+}
+
+static void
+focus_topmost(wlc_handle output)
+{
+   // views of the space are in stacking order
+   size_t memb;
+   const wlc_handle *views = get_space_views(output, get_active_space(output), &memb);
+   focus_view(memb > 0 ? views[memb - 1] : 0);
+}
+
+static void
+focus_recent(wlc_handle output)
+{
+   wlc_handle view;
+   if ((view = recent_view(output, get_active_space(output), 0))) {
+      focus_view(view);
+   } else {
+      focus_topmost(output);
+   }
 }
 
 static void
 focus_space(uint32_t index)
 {
-   assert(sizeof(index) * CHAR_BIT >= index);
-   wlc_output_set_mask(wlc_get_focused_output(), (1 << index));
-   focus_topmost(wlc_get_focused_output());
-   relayout(wlc_get_focused_output());
+   const wlc_handle output = wlc_get_focused_output();
+   spaces_focus_space(output, index);
+   focus_recent(output);
+   relayout(output);
 }
 
 static void
 move_to_space(wlc_handle view, uint32_t index)
 {
-   assert(sizeof(index) * CHAR_BIT >= index);
-   wlc_view_set_mask(view, (1 << index));
+   spaces_move_to_space(view, index);
+   update_view(view);
+   history_touch(view);
    focus_space(index);
 }
 
@@ -281,9 +572,11 @@ static void
 focus_next_or_previous_space(enum direction direction)
 {
    const wlc_handle output = wlc_get_focused_output();
-   wlc_output_set_mask(output, rotate_mask(wlc_output_get_mask(output), 1, direction));
-   focus_topmost(output);
-   relayout(output);
+   const uint32_t memb = get_space_count(output), active = get_active_space(output);
+   if (memb == 0 || active >= memb)
+      return;
+
+   focus_space((direction == PREV ? active + memb - 1 : active + 1) % memb);
 }
 
 static wlc_handle
@@ -298,7 +591,7 @@ static void
 focus_output(wlc_handle output)
 {
    wlc_output_focus(output);
-   focus_topmost(wlc_get_focused_output());
+   focus_recent(wlc_get_focused_output());
    relayout(output);
 }
 
@@ -309,8 +602,9 @@ move_to_output(wlc_handle view, uint32_t index)
    if (!(output = output_for_index(index)))
       return;
 
-   wlc_view_set_mask(view, wlc_output_get_mask(output));
-   wlc_view_set_output(view, output);
+   set_output(view, output);
+   update_view(view);
+   history_touch(view);
    focus_output(output);
 }
 
@@ -326,7 +620,7 @@ set_active_view_on_output(wlc_handle output, wlc_handle view)
    size_t memb;
    const wlc_handle *views = wlc_output_get_views(output, &memb);
    for (size_t i = 0; i < memb; ++i)
-      wlc_view_set_state(views[i], WLC_BIT_ACTIVATED, (views[i] == view));
+      set_state(views[i], WLC_BIT_ACTIVATED, (views[i] == view));
 }
 
 static void
@@ -336,12 +630,12 @@ view_move_to_output(wlc_handle view, wlc_handle from, wlc_handle to)
 
    relayout(from);
    relayout(to);
-   plog(plugin.self, PLOG_INFO, "view %zu moved from output %zu to %zu", view, from, to);
+   plog(plugin.self, PLOG_DEBUG, "view %zu moved from output %zu to %zu", view, from, to);
 
    if (wlc_view_get_state(view) & WLC_BIT_ACTIVATED)
       set_active_view_on_output(to, view);
 
-   focus_topmost(from);
+   focus_recent(from);
 }
 
 static void
@@ -360,7 +654,21 @@ static void
 view_focus(wlc_handle view, bool focus)
 {
    if (wlc_view_get_output(view) == wlc_get_focused_output())
-      wlc_view_set_state(view, WLC_BIT_ACTIVATED, focus);
+      set_state(view, WLC_BIT_ACTIVATED, focus);
+
+   if (!focus)
+      return;
+
+   // Other plugins may focus views directly, layout does when cycling a lazy layout.
+   if (wlc_view_get_output(view) == wlc_get_focused_output())
+      plugin.active.view = view;
+
+   if (plugin.focus.cycle.focusing)
+      return;
+
+   // Focus from elsewhere ends the cycle
+   end_cycle();
+   history_touch(view);
 }
 
 static bool
@@ -371,7 +679,8 @@ view_created(wlc_handle view)
       if (plugin.active.view && wlc_view_get_type(plugin.active.view) & BIT_BEMENU)
          return false;
 
-      wlc_view_set_type(view, BIT_BEMENU, true); // XXX: Hack
+      set_type(view, BIT_BEMENU, true); // XXX: Hack
+      plugin.bemenu = view;
    }
 
    if (should_focus_on_create(view)) {
@@ -382,7 +691,6 @@ view_created(wlc_handle view)
       }
    }
 
-   wlc_view_set_mask(view, wlc_output_get_mask(wlc_view_get_output(view)));
    relayout(wlc_view_get_output(view));
    return true;
 }
@@ -390,6 +698,20 @@ view_created(wlc_handle view)
 static void
 view_destroyed(wlc_handle view)
 {
+   if (plugin.bemenu == view)
+      plugin.bemenu = 0;
+
+   if (plugin.focus.cycle.view == view)
+      plugin.focus.cycle.view = 0;
+
+   if (plugin.focus.cycle.cursor == view)
+      plugin.focus.cycle.cursor = 0;
+
+   if (plugin.action.view == view)
+      memset(&plugin.action, 0, sizeof(plugin.action));
+
+   history_remove(view);
+
    if (plugin.active.view == view) {
       plugin.active.view = 0;
 
@@ -397,11 +719,11 @@ view_destroyed(wlc_handle view)
       if ((v = wlc_view_get_parent(view))) {
          // Focus the parent view, if there was one
          // Set parent 0 before this to avoid focusing back to dying view
-         wlc_view_set_parent(view, 0);
+         set_parent(view, 0);
          focus_view(v);
       } else {
-         // Otherwise focus previous one.
-         focus_topmost(wlc_view_get_output(view));
+         // Otherwise focus the previously focused one.
+         focus_recent(wlc_view_get_output(view));
       }
    }
 
@@ -416,46 +738,9 @@ pointer_motion(wlc_handle view, uint32_t time, const struct wlc_point *motion)
    wlc_pointer_set_position(motion);
 
    if (plugin.action.view) {
-      const int32_t dx = motion->x - plugin.action.grab.x;
-      const int32_t dy = motion->y - plugin.action.grab.y;
-      struct wlc_geometry g = *wlc_view_get_geometry(plugin.action.view);
-
-      if (plugin.action.edges) {
-         const struct wlc_size min = { 80, 40 };
-
-         struct wlc_geometry n = g;
-         if (plugin.action.edges & WLC_RESIZE_EDGE_LEFT) {
-            n.size.w -= dx;
-            n.origin.x += dx;
-         } else if (plugin.action.edges & WLC_RESIZE_EDGE_RIGHT) {
-            n.size.w += dx;
-         }
-
-         if (plugin.action.edges & WLC_RESIZE_EDGE_TOP) {
-            n.size.h -= dy;
-            n.origin.y += dy;
-         } else if (plugin.action.edges & WLC_RESIZE_EDGE_BOTTOM) {
-            n.size.h += dy;
-         }
-
-         if (n.size.w >= min.w) {
-            g.origin.x = n.origin.x;
-            g.size.w = n.size.w;
-         }
-
-         if (n.size.h >= min.h) {
-            g.origin.y = n.origin.y;
-            g.size.h = n.size.h;
-         }
-
-         wlc_view_set_geometry(plugin.action.view, plugin.action.edges, &g);
-      } else {
-         g.origin.x += dx;
-         g.origin.y += dy;
-         wlc_view_set_geometry(plugin.action.view, 0, &g);
-      }
-
-      plugin.action.grab = *motion;
+      // Geometry is applied once per frame in output_pre_render, high rate pointers would flood the client otherwise.
+      plugin.action.pointer = *motion;
+      plugin.action.dirty = true;
    } else if (plugin.config.follow_focus) {
       focus_view(view);
    }
@@ -463,6 +748,16 @@ pointer_motion(wlc_handle view, uint32_t time, const struct wlc_point *motion)
    return (plugin.action.view ? true : false);
 }
 
+static void
+output_pre_render(wlc_handle output)
+{
+   // every output renders, the action belongs to the one showing the view
+   if (!plugin.action.view || output != wlc_view_get_output(plugin.action.view))
+      return;
+
+   apply_interactive_action(false);
+}
+
 static bool
 pointer_button(wlc_handle view, uint32_t time, const struct wlc_modifiers *modifiers, uint32_t button, enum wlc_button_state state, const struct wlc_point *position)
 {
@@ -496,7 +791,7 @@ static void
 key_cb_spawn_terminal(wlc_handle view, uint32_t time, intptr_t arg)
 {
    (void)view, (void)time, (void)arg;
-   wlc_exec(plugin.terminal.data, (char *const[]){ plugin.terminal.data, NULL });
+   exec(plugin.terminal.data, (char *const[]){ plugin.terminal.data, NULL });
 }
 
 static void
@@ -505,7 +800,7 @@ key_cb_spawn_bemenu(wlc_handle view, uint32_t time, intptr_t arg)
    (void)view, (void)time, (void)arg;
    if (plugin.active.view && wlc_view_get_type(plugin.active.view) & BIT_BEMENU)
       return;
-   wlc_exec(DEFAULT_MENU, (char *const[]){ DEFAULT_MENU, NULL });
+   exec(DEFAULT_MENU, (char *const[]){ DEFAULT_MENU, NULL });
 }
 
 static void
@@ -516,7 +811,12 @@ key_cb_toggle_fullscreen(wlc_handle view, uint32_t time, intptr_t arg)
    if (!view)
       return;
 
-   wlc_view_set_state(view, WLC_BIT_FULLSCREEN, !(wlc_view_get_state(view) & WLC_BIT_FULLSCREEN));
+   struct view_info info;
+   if (!get_view(view, &info))
+      return;
+
+   set_state(view, WLC_BIT_FULLSCREEN, !(info.state & WLC_BIT_FULLSCREEN));
+   update_view(view);
    relayout(wlc_view_get_output(view));
 }
 
@@ -584,6 +884,13 @@ key_cb_focus_next_client(wlc_handle view, uint32_t time, intptr_t arg)
    focus_next_or_previous_view(plugin.active.view, NEXT);
 }
 
+static void
+key_cb_cycle_recent_clients(wlc_handle view, uint32_t time, intptr_t arg)
+{
+   (void)view, (void)time, (void)arg;
+   cycle_recent(wlc_get_focused_output());
+}
+
 static void
 key_cb_focus_view(wlc_handle view, uint32_t time, intptr_t arg)
 {
@@ -634,6 +941,7 @@ static const struct {
    { "focus next output", (const char*[]){ "<P-l>", NULL }, key_cb_focus_next_output, 0 },
    { "focus next client", (const char*[]){ "<P-j>", NULL }, key_cb_focus_next_client, 0 },
    { "focus previous client", (const char*[]){ "<P-k>", NULL }, key_cb_focus_previous_client, 0 },
+   { "cycle recent clients", (const char*[]){ "<P-Tab>", NULL }, key_cb_cycle_recent_clients, 0 },
    { "focus space 0", (const char*[]){ "<P-1>", "<P-KP_1>", NULL }, key_cb_focus_space, 0 },
    { "focus space 1", (const char*[]){ "<P-2>", "<P-KP_2>", NULL }, key_cb_focus_space, 1 },
    { "focus space 2", (const char*[]){ "<P-3>", "<P-KP_3>", NULL }, key_cb_focus_space, 2 },
@@ -697,6 +1005,12 @@ plugin_deinit(plugin_h self)
 {
    (void)self;
    chck_string_release(&plugin.terminal);
+
+   if (plugin.focus.cycle.timer)
+      wlc_event_source_remove(plugin.focus.cycle.timer);
+
+   chck_iter_pool_release(&plugin.focus.histories);
+   chck_hash_table_release(&plugin.focus.entries);
 }
 
 bool
@@ -704,37 +1018,67 @@ plugin_init(plugin_h self)
 {
    plugin.self = self;
 
-   plugin_h orbment, keybind, layout;
+   plugin_h orbment, keybind, layout, cache, spaces;
    if (!(orbment = import_plugin(self, "orbment")) ||
        !(keybind = import_plugin(self, "keybind")) ||
-       !(layout = import_plugin(self, "layout")))
+       !(layout = import_plugin(self, "layout")) ||
+       !(cache = import_plugin(self, "view-cache")) ||
+       !(spaces = import_plugin(self, "spaces")))
       return false;
 
-   if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun)|1")) ||
+   if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun,i32)|1")) ||
+       !(exec = import_method(self, orbment, "exec", "b(c[],c*[])|1")) ||
        !(add_keybind = import_method(self, keybind, "add_keybind", "b(h,c[],c*[],fun,ip)|1")) ||
-       !(relayout = import_method(self, layout, "relayout", "v(h)|1")))
+       !(relayout = import_method(self, layout, "schedule_relayout", "v(h)|1")) ||
+       !(update_view = import_method(self, layout, "update_view", "v(h)|1")) ||
+       !(get_view = import_method(self, cache, "get_view", "b(h,*)|1")) ||
+       !(set_state = import_method(self, cache, "set_state", "v(h,e,b)|1")) ||
+       !(set_type = import_method(self, cache, "set_type", "v(h,u32,b)|1")) ||
+       !(set_output = import_method(self, cache, "set_output", "v(h,h)|1")) ||
+       !(set_parent = import_method(self, cache, "set_parent", "v(h,h)|1")) ||
+       !(get_children = import_method(self, cache, "get_children", "*(h,*)|1")) ||
+       !(bring_to_front = import_method(self, cache, "bring_to_front", "v(h)|1")) ||
+       !(get_fullscreen = import_method(self, cache, "get_fullscreen", "h(h)|1")) ||
+       !(spaces_focus_space = import_method(self, spaces, "focus_space", "v(h,u32)|1")) ||
+       !(spaces_move_to_space = import_method(self, spaces, "move_to_space", "v(h,u32)|1")) ||
+       !(get_space = import_method(self, spaces, "get_space", "u32(h)|1")) ||
+       !(get_active_space = import_method(self, spaces, "get_active_space", "u32(h)|1")) ||
+       !(get_space_views = import_method(self, spaces, "get_space_views", "*(h,u32,*)|1")) ||
+       !(get_space_count = import_method(self, spaces, "get_space_count", "u32(h)|1")))
       return false;
 
    if (!setup_default_keybinds(self))
       return false;
 
+   if (!chck_hash_table(&plugin.focus.entries, 0, 256, sizeof(struct history_entry)))
+      return false;
+
+   if (!(plugin.focus.cycle.timer = wlc_event_loop_add_timer(timer_cb_cycle, NULL)))
+      return false;
+
    load_config(self);
-   return (add_hook(self, "view.created", FUN(view_created, "b(h)|1")) &&
-           add_hook(self, "view.destroyed", FUN(view_destroyed, "v(h)|1")) &&
-           add_hook(self, "view.focus", FUN(view_focus, "v(h,b)|1")) &&
-           add_hook(self, "view.move_to_output", FUN(view_move_to_output, "v(h,h,h)|1")) &&
-           add_hook(self, "view.move_request", FUN(view_move_request, "v(h,*)|1")) &&
-           add_hook(self, "view.resize_request", FUN(view_resize_request, "v(h,u32,*)|1")) &&
-           add_hook(self, "pointer.motion", FUN(pointer_motion, "b(h,u32,*)|1")) &&
-           add_hook(self, "pointer.button", FUN(pointer_button, "b(h,u32,*,u32,e,*)|1")));
+   // Pointer hooks run before keybinds, so interactive actions see the button release even when keybind consumes it.
+   return (add_hook(self, "view.created", FUN(view_created, "b(h)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.destroyed", FUN(view_destroyed, "v(h)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.focus", FUN(view_focus, "v(h,b)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.move_to_output", FUN(view_move_to_output, "v(h,h,h)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.move_request", FUN(view_move_request, "v(h,*)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.resize_request", FUN(view_resize_request, "v(h,u32,*)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "output.pre_render", FUN(output_pre_render, "v(h)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "pointer.motion", FUN(pointer_motion, "b(h,u32,*)|1"), HOOK_PRIORITY_HIGH) &&
+           add_hook(self, "pointer.button", FUN(pointer_button, "b(h,u32,*,u32,e,*)|1"), HOOK_PRIORITY_HIGH));
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
    static const char *requires[] = {
       "keybind",
       "layout",
+      "view-cache",
+      "spaces",
       NULL,
    };
 
@@ -122,6 +122,8 @@ plugin_init(plugin_h self)
    return add_hook(self, "input.created", FUN(input_created, "b(*)|1"));
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
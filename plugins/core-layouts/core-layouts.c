@@ -3,6 +3,7 @@
 #include <orbment/plugin.h>
 #include <wlc/wlc.h>
 #include <chck/math/math.h>
+#include "common.h"
 #include "config.h"
 
 static struct {
@@ -17,7 +18,7 @@ static struct {
 
 static void (*relayout)(wlc_handle output);
 
-typedef void (*layout_fun_t)(const struct wlc_geometry *r, const wlc_handle *views, size_t memb);
+typedef void (*layout_fun_t)(const struct wlc_geometry *r, const wlc_handle *views, const struct layout_hint *hints, struct wlc_geometry *out, size_t memb);
 static bool (*add_layout)(plugin_h, const char *name, const struct function*);
 
 typedef void (*keybind_fun_t)(wlc_handle view, uint32_t time, intptr_t arg);
@@ -40,23 +41,21 @@ key_cb_nmaster_shrink(wlc_handle view, uint32_t time, intptr_t arg)
 }
 
 static void
-nmaster(const struct wlc_geometry *r, const wlc_handle *views, size_t memb)
+nmaster(const struct wlc_geometry *r, const wlc_handle *views, const struct layout_hint *hints, struct wlc_geometry *out, size_t memb)
 {
+   (void)views, (void)hints;
    bool toggle = false;
    uint32_t y = 0, height = r->size.h / (memb > 1 ? memb - 1 : 1);
    uint32_t fheight = (r->size.h > height * (memb - 1) ? height + (r->size.h - height * (memb - 1)) : height);
 
    for (size_t i = 0; i < memb; ++i) {
       uint32_t slave = r->size.w * config.nmaster.cut;
-      wlc_view_set_state(views[i], WLC_BIT_MAXIMIZED, true);
 
-      struct wlc_geometry g = {
+      out[i] = (struct wlc_geometry){
          .origin = { r->origin.x + (toggle ? r->size.w - slave : 0), r->origin.y + y },
          .size = { (memb > 1 ? (toggle ? slave : r->size.w - slave) : r->size.w), (toggle ? (y == 0 ? fheight : height) : r->size.h) },
       };
 
-      wlc_view_set_geometry(views[i], 0, &g);
-
       if (toggle)
          y += (y == 0 ? fheight : height);
 
@@ -65,23 +64,30 @@ nmaster(const struct wlc_geometry *r, const wlc_handle *views, size_t memb)
 }
 
 static void
-grid(const struct wlc_geometry *r, const wlc_handle *views, size_t memb)
+grid(const struct wlc_geometry *r, const wlc_handle *views, const struct layout_hint *hints, struct wlc_geometry *out, size_t memb)
 {
+   (void)views, (void)hints;
    bool toggle = false;
    uint32_t y = 0;
    uint32_t w = r->size.w / 2, h = r->size.h / chck_maxu32((1 + memb) / 2, 1);
    for (size_t i = 0; i < memb; ++i) {
-      struct wlc_geometry g = { { r->origin.x + (toggle ? w : 0), r->origin.y + y }, { (!toggle && i == memb - 1 ? r->size.w : w), h } };
-      wlc_view_set_geometry(views[i], 0, &g);
+      out[i] = (struct wlc_geometry){ { r->origin.x + (toggle ? w : 0), r->origin.y + y }, { (!toggle && i == memb - 1 ? r->size.w : w), h } };
       y = y + (!(toggle = !toggle) ? h : 0);
    }
 }
 
 static void
-monocle(const struct wlc_geometry *r, const wlc_handle *views, size_t memb)
+monocle(const struct wlc_geometry *r, const wlc_handle *views, const struct layout_hint *hints, struct wlc_geometry *out, size_t memb)
 {
+   (void)views;
+
+   size_t active;
+   for (active = 0; active < memb && !hints[active].active; ++active);
+
+   // Only the active view is visible, rest are sized when they get activated.
+   // Without active view there is no telling which one is on top.
    for (size_t i = 0; i < memb; ++i)
-      wlc_view_set_geometry(views[i], 0, r);
+      out[i] = (active == memb || i == active ? *r : (struct wlc_geometry){ { 0, 0 }, { 0, 0 } });
 }
 
 static const struct {
@@ -114,12 +120,12 @@ plugin_init(plugin_h self)
       return false;
 
    if (!(add_keybind = import_method(self, keybind, "add_keybind", "b(h,c[],c*[],fun,ip)|1")) ||
-       !(relayout = import_method(self, layout, "relayout", "v(h)|1")) ||
+       !(relayout = import_method(self, layout, "schedule_relayout", "v(h)|1")) ||
        !(add_layout = import_method(self, layout, "add_layout", "b(h,c[],fun)|1")))
       return false;
 
    for (size_t i = 0; layouts[i].name; ++i)
-      if (!add_layout(self, layouts[i].name, FUN(layouts[i].function, "v(*,h[],sz)|1")))
+      if (!add_layout(self, layouts[i].name, FUN(layouts[i].function, "v(*,h[],*,*,sz)|1")))
          return false;
 
    for (size_t i = 0; keybinds[i].name; ++i)
@@ -129,6 +135,8 @@ plugin_init(plugin_h self)
    return true;
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
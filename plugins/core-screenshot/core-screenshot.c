@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <time.h>
 #include <orbment/plugin.h>
@@ -7,6 +8,7 @@
 #include <wlc/wlc-render.h>
 #include <chck/math/math.h>
 #include <chck/string/string.h>
+#include <chck/pool/pool.h>
 #include <chck/thread/queue/queue.h>
 #include <pthread.h>
 #include "config.h"
@@ -23,6 +25,14 @@ struct compressor {
 
 struct compressor* (*list_compressors)(const char *type, const char *stsign, const char *funsign, size_t *out_memb);
 
+// Compressors are lazy plugins, they are imported on first screenshot in that format.
+// Format of plugin "compressor-<name>" in the compressor group is name.
+struct format {
+   struct chck_string name, plugin;
+};
+
+static const char** (*list_group)(const char *name, size_t *out_memb);
+
 typedef void (*keybind_fun_t)(wlc_handle view, uint32_t time, intptr_t arg);
 static bool (*add_keybind)(plugin_h, const char *name, const char **syntax, const struct function*, intptr_t arg);
 static bool (*add_hook)(plugin_h, const char *name, const struct function*);
@@ -30,11 +40,14 @@ static bool (*add_hook)(plugin_h, const char *name, const struct function*);
 static struct {
    struct {
       wlc_handle output; // if != 0, screenshot will be taken in next frame and reset after to 0
-      size_t compressor;
+      size_t format;
    } action;
 
+   // struct format, index is the keybind argument
+   struct chck_iter_pool formats;
+
    struct chck_tqueue tqueue;
-   plugin_h self;
+   plugin_h self, compressor;
 } plugin;
 
 struct image {
@@ -106,15 +119,50 @@ error1:
    chck_string_release(&name);
 }
 
+static bool
+import_compressor(const struct format *format)
+{
+   assert(format);
+
+   if (!list_compressors) {
+      if (!(plugin.compressor = import_plugin(plugin.self, "compressor")) ||
+          !(list_compressors = import_method(plugin.self, plugin.compressor, "list_compressors", "*(c[],c[],c[],sz*)|1")))
+         return false;
+   }
+
+   return import_plugin(plugin.self, format->plugin.data);
+}
+
 static void
 key_cb_screenshot(wlc_handle view, uint32_t time, intptr_t arg)
 {
    (void)view, (void)time;
+
+   const struct format *format;
+   if (!(format = chck_iter_pool_get(&plugin.formats, arg)))
+      return;
+
+   if (!import_compressor(format)) {
+      plog(plugin.self, PLOG_ERROR, "Could not load '%s compressor'", format->name.data);
+      return;
+   }
+
    plugin.action.output = wlc_get_focused_output();
-   plugin.action.compressor = arg;
+   plugin.action.format = arg;
    wlc_output_schedule_render(wlc_get_focused_output());
 }
 
+static void
+plugin_deloaded(plugin_h ph)
+{
+   if (plugin.compressor != ph)
+      return;
+
+   // imported again on next screenshot
+   plugin.compressor = 0;
+   list_compressors = NULL;
+}
+
 static void
 output_post_render(wlc_handle output)
 {
@@ -123,10 +171,20 @@ output_post_render(wlc_handle output)
 
    plugin.action.output = 0;
 
-   size_t memb;
+   if (!list_compressors)
+      return;
+
+   size_t memb, i;
+   const struct format *format;
+   if (!(format = chck_iter_pool_get(&plugin.formats, plugin.action.format)))
+      return;
+
+   const char *name = format->name.data;
    struct compressor *compressors = list_compressors("image", struct_signature, compress_signature, &memb);
-   if (!memb || plugin.action.compressor >= memb) {
-      plog(plugin.self, PLOG_ERROR, "Could not find compressor for index (%zu)", plugin.action.compressor);
+   for (i = 0; i < memb && !chck_cstreq(compressors[i].name, name); ++i);
+
+   if (i >= memb) {
+      plog(plugin.self, PLOG_ERROR, "Could not find compressor for format (%s)", name);
       return;
    }
 
@@ -144,13 +202,42 @@ output_post_render(wlc_handle output)
          .data = rgba,
       },
       .dimensions = out.size,
-      .compressor = compressors[plugin.action.compressor],
+      .compressor = compressors[i],
    };
 
    if (!chck_tqueue_add_task(&plugin.tqueue, &work, 0))
       free(rgba);
 }
 
+static bool
+add_format(const char *member)
+{
+   assert(member);
+
+   // the api is in the group too
+   if (chck_cstreq(member, "compressor"))
+      return true;
+
+   static const char prefix[] = "compressor-";
+   if (strncmp(member, prefix, sizeof(prefix) - 1) || !member[sizeof(prefix) - 1]) {
+      plog(plugin.self, PLOG_WARN, "Compressor plugin '%s' is not named compressor-<format>, no screenshot keybind for it", member);
+      return true;
+   }
+
+   struct format format = {{0}};
+   if (!chck_string_set_cstr(&format.name, member + sizeof(prefix) - 1, true) ||
+       !chck_string_set_cstr(&format.plugin, member, true) ||
+       !chck_iter_pool_push_back(&plugin.formats, &format))
+      goto error0;
+
+   return true;
+
+error0:
+   chck_string_release(&format.name);
+   chck_string_release(&format.plugin);
+   return false;
+}
+
 #pragma GCC diagnostic ignored "-Wmissing-prototypes"
 
 void
@@ -158,6 +245,14 @@ plugin_deinit(plugin_h self)
 {
    (void)self;
    chck_tqueue_release(&plugin.tqueue);
+
+   struct format *f;
+   chck_iter_pool_for_each(&plugin.formats, f) {
+      chck_string_release(&f->name);
+      chck_string_release(&f->plugin);
+   }
+
+   chck_iter_pool_release(&plugin.formats);
 }
 
 bool
@@ -165,26 +260,36 @@ plugin_init(plugin_h self)
 {
    plugin.self = self;
 
-   plugin_h orbment, keybind, compressor;
+   plugin_h orbment, keybind;
    if (!(orbment = import_plugin(self, "orbment")) ||
-       !(keybind = import_plugin(self, "keybind")) ||
-       !(compressor = import_plugin(self, "compressor")))
+       !(keybind = import_plugin(self, "keybind")))
       return false;
 
    if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun)|1")) ||
-       !(add_keybind = import_method(self, keybind, "add_keybind", "b(h,c[],c*[],fun,ip)|1")) ||
-       !(list_compressors = import_method(self, compressor, "list_compressors", "*(c[],c[],c[],sz*)|1")))
+       !(list_group = import_method(self, orbment, "list_group", "c*[](c[],sz*)|1")) ||
+       !(add_keybind = import_method(self, keybind, "add_keybind", "b(h,c[],c*[],fun,ip)|1")))
+      return false;
+
+   if (!add_hook(self, "output.post_render", FUN(output_post_render, "v(h)|1")) ||
+       !add_hook(self, "plugin.deloaded", FUN(plugin_deloaded, "v(h)|1")))
       return false;
 
-   if (!add_hook(self, "output.post_render", FUN(output_post_render, "v(h)|1")))
+   if (!chck_iter_pool(&plugin.formats, 4, 0, sizeof(struct format)))
       return false;
 
+   // members of the group are listed without loading them
    size_t memb;
-   struct compressor *compressors = list_compressors("image", struct_signature, compress_signature, &memb);
+   const char **members = list_group("compressor", &memb);
    for (size_t i = 0; i < memb; ++i) {
+      if (!add_format(members[i]))
+         return false;
+   }
+
+   const struct format *f;
+   chck_iter_pool_for_each(&plugin.formats, f) {
       struct chck_string name = {0};
-      chck_string_set_format(&name, "take screenshot %s", compressors[i].name);
-      const bool ret = add_keybind(self, name.data, (chck_cstreq(compressors[i].name, "png") ? (const char*[]){ "<SunPrint_Screen>", "<P-s>", NULL } : NULL), FUN(key_cb_screenshot, "v(h,u32,ip)|1"), i);
+      chck_string_set_format(&name, "take screenshot %s", f->name.data);
+      const bool ret = add_keybind(self, name.data, (chck_cstreq(f->name.data, "png") ? (const char*[]){ "<SunPrint_Screen>", "<P-s>", NULL } : NULL), FUN(key_cb_screenshot, "v(h,u32,ip)|1"), _I - 1);
       chck_string_release(&name);
 
       if (!ret)
@@ -197,12 +302,13 @@ plugin_init(plugin_h self)
    return true;
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
    static const char *requires[] = {
       "keybind",
-      "compressor",
       NULL,
    };
 
@@ -63,6 +63,8 @@ plugin_init(plugin_h self)
    return true;
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
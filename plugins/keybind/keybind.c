@@ -6,6 +6,7 @@
 #include <chck/string/string.h>
 #include <chck/unicode/unicode.h>
 #include <ctype.h>
+#include <inttypes.h>
 #include "common.h"
 #include "config.h"
 
@@ -16,9 +17,23 @@ static const size_t NOTINDEX = (size_t)-1;
 static bool (*add_hook)(plugin_h, const char *name, const struct function*);
 static bool (*configuration_get)(const char *key, const char type, void *value_out);
 
+/**
+ * Keybinds are matched against canonical combos instead of syntax strings.
+ * Upper 32 bits contain the modifier mask and lower 32 bits the symbol.
+ * Symbol is either keysym, printable UTF-32 codepoint or mouse button, see the bits below.
+ */
+typedef uint64_t combo_t;
+
+enum {
+   // keysyms never use bits above 28
+   COMBO_BIT_UTF32 = 1<<29,
+   COMBO_BIT_BUTTON = 1<<30,
+};
+
 typedef void (*keybind_fun_t)(wlc_handle view, uint32_t time, intptr_t arg);
 struct keybind {
    struct chck_string name;
+   struct chck_iter_pool combos;
    const char **defaults;
    keybind_fun_t function;
    intptr_t arg;
@@ -71,24 +86,34 @@ parse_prefix(const char *str)
    return (prefix ? prefix : def);
 }
 
-static bool
-syntax_append(struct chck_string *syntax, const char *cstr, bool is_heap)
+static inline uint32_t
+combo_mods(uint32_t mods)
 {
-   assert(syntax && cstr);
-
-   if (syntax->size > 0)
-      return chck_string_set_format(syntax, "%s-%s", syntax->data, cstr);
+   // Caps lock can't be expressed in the syntax, so it must not affect matching.
+   return mods & ~WLC_BIT_MOD_CAPS;
+}
 
-   return chck_string_set_cstr(syntax, cstr, is_heap);
+static inline combo_t
+combo_for(uint32_t mods, uint32_t sym)
+{
+   return ((combo_t)combo_mods(mods) << 32) | sym;
 }
 
 static bool
-append_mods(struct chck_string *syntax, struct chck_string *prefixed, uint32_t mods)
+is_printable_utf32(uint32_t u32)
 {
-   assert(syntax && prefixed);
+   char u8[4];
+   const uint8_t mb = chck_utf32_encode(u32, u8);
+   return (mb > 1 || (mb == 1 && isprint(u8[0]) && !isspace(u8[0])));
+}
 
-   if (mods == plugin.prefix && !syntax_append(prefixed, "P", false))
-      return false;
+static uint32_t
+mod_for_name(const char *name, size_t len)
+{
+   assert(name);
+
+   if (len == 1 && name[0] == 'P')
+      return plugin.prefix;
 
    static const struct {
       const char *name;
@@ -105,13 +130,76 @@ append_mods(struct chck_string *syntax, struct chck_string *prefixed, uint32_t m
    };
 
    for (uint32_t i = 0; map[i].name; ++i) {
-      if (!(mods & map[i].mod))
-         continue;
+      if (strlen(map[i].name) == len && chck_cstrneq(map[i].name, name, len))
+         return map[i].mod;
+   }
+
+   return 0;
+}
+
+static bool
+sym_for_name(const char *name, uint32_t *out_sym)
+{
+   assert(name && out_sym);
+
+   if (name[0] == 'B' && name[1]) {
+      uint32_t button;
+      if (chck_cstr_to_u32(name + 1, &button) && !(button & (COMBO_BIT_UTF32 | COMBO_BIT_BUTTON))) {
+         *out_sym = COMBO_BIT_BUTTON | button;
+         return true;
+      }
+   }
+
+   if (chck_utf8_validate(name) && chck_utf8_mblen(name) == strlen(name)) {
+      const uint32_t u32 = chck_utf8_codepoint(name);
+      if (is_printable_utf32(u32)) {
+         *out_sym = COMBO_BIT_UTF32 | u32;
+         return true;
+      }
+   }
+
+   const xkb_keysym_t sym = xkb_keysym_from_name(name, XKB_KEYSYM_NO_FLAGS);
+   if (sym == XKB_KEY_NoSymbol || (sym & (COMBO_BIT_UTF32 | COMBO_BIT_BUTTON)))
+      return false;
+
+   *out_sym = sym;
+   return true;
+}
+
+/**
+ * Parses keybind syntax, such as <P-S-Return> or <B0>, into canonical combo.
+ */
+static bool
+parse_combo(const char *syntax, combo_t *out_combo)
+{
+   assert(out_combo);
 
-      if (!syntax_append(syntax, map[i].name, false))
+   size_t len;
+   if (chck_cstr_is_empty(syntax) || (len = strlen(syntax)) < 3 || syntax[0] != '<' || syntax[len - 1] != '>')
+      return false;
+
+   uint32_t mods = 0;
+   const char *s = syntax + 1, *end = syntax + len - 1;
+   for (const char *d; (d = memchr(s, '-', end - s)) && d + 1 < end; s = d + 1) {
+      uint32_t mod;
+      if (!(mod = mod_for_name(s, d - s)))
          return false;
+
+      mods |= mod;
    }
 
+   char name[64];
+   if ((size_t)(end - s) >= sizeof(name))
+      return false;
+
+   memcpy(name, s, end - s);
+   name[end - s] = 0;
+
+   uint32_t sym;
+   if (!sym_for_name(name, &sym))
+      return false;
+
+   *out_combo = combo_for(mods, sym);
    return true;
 }
 
@@ -128,30 +216,39 @@ keybind_exists(const char *name)
 }
 
 static const struct keybind*
-keybind_for_syntax(const char *syntax)
+keybind_for_combo(combo_t combo)
 {
    size_t *index;
-   if (chck_cstr_is_empty(syntax) || !(index = chck_hash_table_str_get(&plugin.keybinds.table, syntax, strlen(syntax))) || *index == NOTINDEX)
+   if (!(index = chck_hash_table_str_get(&plugin.keybinds.table, (const char*)&combo, sizeof(combo))) || *index == NOTINDEX)
       return NULL;
 
    return chck_pool_get(&plugin.keybinds.pool, *index);
 }
 
 static bool
-add_keybind_mapping(struct chck_string *mappings, const char *syntax, size_t *index)
+add_keybind_mapping(struct chck_string *mappings, struct chck_iter_pool *combos, const char *syntax, size_t *index)
 {
-   assert(mappings && index);
+   assert(mappings && combos && index);
 
    if (chck_cstr_is_empty(syntax))
       return false;
 
+   combo_t combo;
+   if (!parse_combo(syntax, &combo)) {
+      plog(plugin.self, PLOG_WARN, "Invalid keybind syntax '%s'", syntax);
+      return false;
+   }
+
    const struct keybind *o;
-   if ((o = keybind_for_syntax(syntax))) {
+   if ((o = keybind_for_combo(combo))) {
       plog(plugin.self, PLOG_WARN, "'%s' is already mapped to keybind '%s'", syntax, o->name.data);
       return false;
    }
 
-   chck_hash_table_str_set(&plugin.keybinds.table, syntax, strlen(syntax), index);
+   if (!chck_iter_pool_push_back(combos, &combo))
+      return false;
+
+   chck_hash_table_str_set(&plugin.keybinds.table, (const char*)&combo, sizeof(combo), index);
    chck_string_set_format(mappings, (mappings->size > 0 ? "%s, %s" : "%s%s"), (mappings->data ? mappings->data : ""), syntax);
    return true;
 }
@@ -190,10 +287,14 @@ add_keybind(plugin_h caller, const char *name, const char **syntax, const struct
    if (!chck_string_set_cstr(&k.name, name, true))
       return false;
 
-   size_t index;
-   if (!chck_pool_add(&plugin.keybinds.pool, &k, &index))
+   if (!chck_iter_pool(&k.combos, 1, 0, sizeof(combo_t)))
       goto error0;
 
+   size_t index;
+   struct keybind *kp;
+   if (!(kp = chck_pool_add(&plugin.keybinds.pool, &k, &index)))
+      goto error1;
+
    struct chck_string mappings = {0};
    bool mapped = false;
 
@@ -207,7 +308,7 @@ add_keybind(plugin_h caller, const char *name, const char **syntax, const struct
 
       const char *value;
       if (configuration_get(key.data, 's', &value)) {
-         add_keybind_mapping(&mappings, value, &index);
+         add_keybind_mapping(&mappings, &kp->combos, value, &index);
          mapped = true;
       }
 
@@ -217,13 +318,15 @@ add_keybind(plugin_h caller, const char *name, const char **syntax, const struct
    /* If no mapping was set from configuration, try to use default keybindings */
    if (!mapped) {
       for (uint32_t i = 0; syntax && syntax[i]; ++i)
-         add_keybind_mapping(&mappings, syntax[i], &index);
+         add_keybind_mapping(&mappings, &kp->combos, syntax[i], &index);
    }
 
    plog(plugin.self, PLOG_INFO, "Added keybind: %s (%s)", name, (chck_string_is_empty(&mappings) ? "none" : mappings.data));
    chck_string_release(&mappings);
    return true;
 
+error1:
+   chck_iter_pool_release(&k.combos);
 error0:
    chck_string_release(&k.name);
    return false;
@@ -235,6 +338,11 @@ keybind_release(struct keybind *keybind)
    if (!keybind)
       return;
 
+   const combo_t *c;
+   chck_iter_pool_for_each(&keybind->combos, c)
+      chck_hash_table_str_set(&plugin.keybinds.table, (const char*)c, sizeof(*c), &NOTINDEX);
+
+   chck_iter_pool_release(&keybind->combos);
    chck_string_release(&keybind->name);
 }
 
@@ -282,75 +390,46 @@ plugin_deloaded(plugin_h ph)
 }
 
 static bool
-pass_key(wlc_handle view, uint32_t time, const struct wlc_modifiers *modifiers, const char name[64], bool pressed)
+pass_combo(wlc_handle view, uint32_t time, combo_t combo, bool pressed)
 {
-   assert(modifiers);
-
-   bool handled = false;
-
-   struct chck_string syntax = {0}, prefixed = {0};
-   if (!append_mods(&syntax, &prefixed, modifiers->mods))
-      goto out;
-
-   syntax_append(&syntax, name, true);
-   chck_string_set_format(&syntax, "<%s>", syntax.data);
-
-   if (!chck_string_is_empty(&prefixed)) {
-      syntax_append(&prefixed, name, true);
-      chck_string_set_format(&prefixed, "<%s>", prefixed.data);
-   }
-
-   plog(plugin.self, PLOG_INFO, "%s combo: %s %s", (pressed ? "pressed" : "released"), syntax.data, prefixed.data);
+   plog(plugin.self, PLOG_TRACE, "%s combo %#" PRIx64, (pressed ? "pressed" : "released"), combo);
 
    const struct keybind *k;
-   if (!(k = keybind_for_syntax(prefixed.data)) && !(k = keybind_for_syntax(syntax.data)))
-      goto out;
+   if (!(k = keybind_for_combo(combo)))
+      return false;
 
    if (pressed)
       k->function(view, time, k->arg);
 
-   handled = true;
-
-out:
-   chck_string_release(&syntax);
-   chck_string_release(&prefixed);
-   return handled;
+   return true;
 }
 
 static bool
 keyboard_key(wlc_handle view, uint32_t time, const struct wlc_modifiers *modifiers, uint32_t key, enum wlc_key_state state)
 {
-   (void)key;
+   assert(modifiers);
 
-   const uint32_t sym = wlc_keyboard_get_keysym_for_key(key, NULL);
    const uint32_t u32 = wlc_keyboard_get_utf32_for_key(key, NULL);
 
-   char name[64] = {0};
-   const uint8_t mb = chck_utf32_encode(u32, name);
-   if (!mb || (mb == 1 && (!isprint(name[0]) || isspace(name[0])))) {
-      if (xkb_keysym_get_name(sym, name, sizeof(name)) == -1)
-         return false;
+   uint32_t sym;
+   if (is_printable_utf32(u32)) {
+      sym = COMBO_BIT_UTF32 | u32;
+   } else if ((sym = wlc_keyboard_get_keysym_for_key(key, NULL)) == XKB_KEY_NoSymbol) {
+      return false;
    }
 
    const bool pressed = (state == WLC_KEY_STATE_PRESSED);
-   return pass_key(view, time, modifiers, name, pressed);
+   return pass_combo(view, time, combo_for(modifiers->mods, sym), pressed);
 }
 
 static bool
 pointer_button(wlc_handle view, uint32_t time, const struct wlc_modifiers *modifiers, uint32_t button, enum wlc_button_state state, const struct wlc_point *point)
 {
    (void)point;
-
-   bool handled = false;
-   struct chck_string name = {0};
-   if (!chck_string_set_format(&name, "B%u", button - BTN_MOUSE))
-      goto out;
+   assert(modifiers);
 
    const bool pressed = (state == WLC_BUTTON_STATE_PRESSED);
-   handled = pass_key(view, time, modifiers, name.data, pressed);
-
-out:
-   chck_string_release(&name);
+   const bool handled = pass_combo(view, time, combo_for(modifiers->mods, COMBO_BIT_BUTTON | (button - BTN_MOUSE)), pressed);
    return (modifiers->mods ? handled : false);
 }
 
@@ -394,6 +473,8 @@ plugin_init(plugin_h self)
            add_hook(self, "pointer.button", FUN(pointer_button, "b(h,u32,*,u32,e,*)|1")));
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
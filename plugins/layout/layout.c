@@ -3,22 +3,49 @@
 #include <chck/pool/pool.h>
 #include <chck/lut/lut.h>
 #include <chck/string/string.h>
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <inttypes.h>
 #include "common.h"
 #include "config.h"
 
-static const size_t NOTINDEX = (size_t)-1;
-
 typedef void (*keybind_fun_t)(wlc_handle view, uint32_t time, intptr_t arg);
 static bool (*add_keybind)(plugin_h, const char *name, const char **syntax, const struct function*, intptr_t arg);
-static bool (*add_hook)(plugin_h, const char *name, const struct function*);
+static bool (*add_hook)(plugin_h, const char *name, const struct function*, int32_t priority);
+static bool (*get_view)(wlc_handle view, struct view_info *out_info);
+static void (*set_state)(wlc_handle view, enum wlc_view_state_bit state, bool toggle);
+static wlc_handle (*get_root)(wlc_handle view);
+static void (*bring_to_front)(wlc_handle view);
+static uint32_t (*get_space)(wlc_handle view);
+static uint32_t (*get_active_space)(wlc_handle output);
+static const wlc_handle* (*get_space_views)(wlc_handle output, uint32_t index, size_t *out_memb);
+
+// Fills geometries for views, relayout applies them.
+typedef void (*layout_fun_t)(const struct wlc_geometry *region, const wlc_handle *views, const struct layout_hint *hints, struct wlc_geometry *out_geometries, size_t memb);
+
+// Old signature, the function sets view geometry itself.
+typedef void (*legacy_layout_fun_t)(const struct wlc_geometry *region, const wlc_handle *views, size_t memb);
 
-typedef void (*layout_fun_t)(const struct wlc_geometry *region, const wlc_handle *views, size_t memb);
 struct layout {
    struct chck_string name;
    layout_fun_t function;
+   legacy_layout_fun_t legacy;
    plugin_h owner;
 };
 
+// Tiled views of one space of output, in layout order.
+struct space {
+   struct chck_iter_pool views;
+   wlc_handle output;
+   uint32_t index;
+};
+
+struct membership {
+   wlc_handle output;
+   uint32_t index;
+   bool valid;
+};
+
 static struct {
    struct {
       // simplest data structure to cycle
@@ -28,6 +55,39 @@ static struct {
       struct chck_hash_table active;
    } layouts;
 
+   struct {
+      // outputs waiting for relayout on next output.pre_render
+      struct chck_iter_pool dirty;
+
+      struct {
+         uint64_t scheduled, coalesced, deferred, immediate;
+      } stats;
+   } relayouts;
+
+   struct {
+      // kept up to date from view hooks and update_view, so relayout does not have to filter every view.
+      // outputs * used spaces is small, linear search is fine.
+      struct chck_iter_pool spaces;
+
+      // view -> struct membership, the tiled list view is in
+      struct chck_hash_table members;
+   } tiling;
+
+   struct {
+      // geometry and state changes sent to wlc, skipped as no-ops, and views left for later by lazy layouts
+      uint64_t submitted, avoided, postponed;
+
+      // view -> bool, views a layout left zero sized, see struct layout_hint
+      struct chck_hash_table postponed_views;
+   } configures;
+
+   struct {
+      // scratch for apply_layout, grows to the largest tiled space seen and is never shrunk
+      struct layout_hint *hints;
+      struct wlc_geometry *geometries;
+      size_t allocated;
+   } scratch;
+
    plugin_h self;
 } plugin;
 
@@ -83,9 +143,11 @@ add_layout(plugin_h caller, const char *name, const struct function *fun)
    if (!name || !fun || !caller)
       return false;
 
-   static const char *signature = "v(*,h[],sz)|1";
+   static const char *signature = "v(*,h[],*,*,sz)|1";
+   static const char *legacy_signature = "v(*,h[],sz)|1";
+   const bool legacy = chck_cstreq(fun->signature, legacy_signature);
 
-   if (!chck_cstreq(fun->signature, signature)) {
+   if (!legacy && !chck_cstreq(fun->signature, signature)) {
       plog(plugin.self, PLOG_WARN, "Wrong signature provided for '%s layout' function. (%s != %s)", name, signature, fun->signature);
       return false;
    }
@@ -99,7 +161,8 @@ add_layout(plugin_h caller, const char *name, const struct function *fun)
       return false;
 
    struct layout l = {
-      .function = fun->function,
+      .function = (legacy ? NULL : fun->function),
+      .legacy = (legacy ? fun->function : NULL),
       .owner = caller,
    };
 
@@ -174,6 +237,202 @@ remove_layouts(void)
    chck_hash_table_release(&plugin.layouts.active);
 }
 
+static struct space*
+space_for(wlc_handle output, uint32_t index, bool create)
+{
+   struct space *s;
+   chck_iter_pool_for_each(&plugin.tiling.spaces, s) {
+      if (s->output == output && s->index == index)
+         return s;
+   }
+
+   if (!create)
+      return NULL;
+
+   if (!plugin.tiling.spaces.items.member && !chck_iter_pool(&plugin.tiling.spaces, 4, 0, sizeof(struct space)))
+      return NULL;
+
+   struct space space = {
+      .output = output,
+      .index = index,
+   };
+
+   if (!chck_iter_pool(&space.views, 8, 0, sizeof(wlc_handle)))
+      return NULL;
+
+   if (!(s = chck_iter_pool_push_back(&plugin.tiling.spaces, &space)))
+      chck_iter_pool_release(&space.views);
+
+   return s;
+}
+
+static struct membership*
+membership_for(wlc_handle view)
+{
+   struct membership *m;
+   if (!plugin.tiling.members.lut.table || !(m = chck_hash_table_str_get(&plugin.tiling.members, (const char*)&view, sizeof(view))) || !m->valid)
+      return NULL;
+
+   return m;
+}
+
+static struct space*
+space_for_view(wlc_handle view, size_t *out_index)
+{
+   assert(out_index);
+
+   const struct membership *m;
+   struct space *s;
+   if (!(m = membership_for(view)) || !(s = space_for(m->output, m->index, false)))
+      return NULL;
+
+   const wlc_handle *v;
+   chck_iter_pool_for_each(&s->views, v) {
+      if (*v != view)
+         continue;
+
+      *out_index = _I - 1;
+      return s;
+   }
+
+   return NULL;
+}
+
+static void
+space_release(struct space *space)
+{
+   if (!space)
+      return;
+
+   chck_iter_pool_release(&space->views);
+}
+
+static void
+remove_view(wlc_handle view)
+{
+   size_t index;
+   struct space *s;
+   if ((s = space_for_view(view, &index)))
+      chck_iter_pool_remove(&s->views, index);
+
+   struct membership *m;
+   if ((m = membership_for(view)))
+      m->valid = false;
+}
+
+static void
+add_view(struct space *space, wlc_handle view)
+{
+   assert(space);
+
+   const struct membership m = {
+      .output = space->output,
+      .index = space->index,
+      .valid = true,
+   };
+
+   if (!chck_hash_table_str_set(&plugin.tiling.members, (const char*)&view, sizeof(view), &m))
+      return;
+
+   if (!chck_iter_pool_push_back(&space->views, &view))
+      remove_view(view);
+}
+
+/**
+ * Moves view to the tiled list it belongs to, or drops it if it is not tiled anymore.
+ * Must be called when anything is_tiled depends on, the space or the output of view changes.
+ * Hooks of this plugin take care of creation, destruction, state requests and output moves.
+ */
+static void
+update_view(wlc_handle view)
+{
+   if (!view)
+      return;
+
+   struct view_info info = {0};
+   const bool tiled = (get_view(view, &info) && info.output && info_is_tiled(&info));
+   const wlc_handle output = info.output;
+   const uint32_t space = get_space(view);
+
+   size_t index;
+   struct space *s;
+   if ((s = space_for_view(view, &index))) {
+      if (tiled && s->output == output && s->index == space)
+         return;
+
+      remove_view(view);
+   }
+
+   if (tiled && (s = space_for(output, space, true)))
+      add_view(s, view);
+}
+
+static void
+remove_spaces_for_output(wlc_handle output)
+{
+   struct space *s;
+   chck_iter_pool_for_each(&plugin.tiling.spaces, s) {
+      if (s->output != output)
+         continue;
+
+      const wlc_handle *v;
+      chck_iter_pool_for_each(&s->views, v) {
+         struct membership *m;
+         if ((m = membership_for(*v)))
+            m->valid = false;
+      }
+
+      space_release(s);
+      chck_iter_pool_remove(&plugin.tiling.spaces, _I - 1);
+      --_I;
+   }
+}
+
+static void
+remove_spaces(void)
+{
+   chck_iter_pool_for_each_call(&plugin.tiling.spaces, space_release);
+   chck_iter_pool_release(&plugin.tiling.spaces);
+   chck_hash_table_release(&plugin.tiling.members);
+}
+
+static inline bool
+geometry_eq(const struct wlc_geometry *a, const struct wlc_geometry *b)
+{
+   assert(a && b);
+   return (a->origin.x == b->origin.x && a->origin.y == b->origin.y && a->size.w == b->size.w && a->size.h == b->size.h);
+}
+
+/**
+ * Pending geometry and state of wlc is the last one applied to the view, by us or anyone else.
+ * Only submit real changes, every change may configure the client and make it redraw.
+ */
+static void
+set_view_geometry(wlc_handle view, uint32_t edges, const struct wlc_geometry *geometry)
+{
+   const struct wlc_geometry *current;
+   if (!geometry || ((current = wlc_view_get_geometry(view)) && geometry_eq(current, geometry))) {
+      plugin.configures.avoided++;
+      return;
+   }
+
+   plugin.configures.submitted++;
+   wlc_view_set_geometry(view, edges, geometry);
+}
+
+static void
+set_view_state(wlc_handle view, enum wlc_view_state_bit state, bool toggle)
+{
+   struct view_info info;
+   if (get_view(view, &info) && !(info.state & state) == !toggle) {
+      plugin.configures.avoided++;
+      return;
+   }
+
+   plugin.configures.submitted++;
+   set_state(view, state, toggle);
+}
+
 static void
 layout_parent(wlc_handle view, wlc_handle parent, const struct wlc_size *size)
 {
@@ -181,8 +440,7 @@ layout_parent(wlc_handle view, wlc_handle parent, const struct wlc_size *size)
 
    // Size to fit the undermost parent
    // TODO: Use surface height as base instead of current
-   wlc_handle under;
-   for (under = parent; under && wlc_view_get_parent(under); under = wlc_view_get_parent(under));
+   const wlc_handle under = get_root(parent);
 
    // Undermost view and parent view geometry
    const struct wlc_geometry *u = wlc_view_get_geometry(under);
@@ -197,7 +455,79 @@ layout_parent(wlc_handle view, wlc_handle parent, const struct wlc_size *size)
    g.size.h = chck_minf(ch, u->size.h * 0.8);
    g.origin.x = p->size.w * 0.5 - g.size.w * 0.5;
    g.origin.y = p->size.h * 0.5 - g.size.h * 0.5;
-   wlc_view_set_geometry(view, 0, &g);
+   set_view_geometry(view, 0, &g);
+}
+
+static bool
+reserve_scratch(size_t memb)
+{
+   if (memb <= plugin.scratch.allocated)
+      return true;
+
+   const size_t allocated = chck_maxsz(memb, plugin.scratch.allocated * 2);
+
+   void *tmp;
+   if (!(tmp = chck_realloc_mul_of(plugin.scratch.hints, allocated, sizeof(*plugin.scratch.hints))))
+      return false;
+
+   plugin.scratch.hints = tmp;
+
+   if (!(tmp = chck_realloc_mul_of(plugin.scratch.geometries, allocated, sizeof(*plugin.scratch.geometries))))
+      return false;
+
+   plugin.scratch.geometries = tmp;
+   plugin.scratch.allocated = allocated;
+   return true;
+}
+
+static void
+apply_layout(const struct layout *layout, const struct wlc_geometry *region, const wlc_handle *views, size_t memb)
+{
+   assert(layout && region);
+
+   if (layout->legacy) {
+      layout->legacy(region, views, memb);
+      return;
+   }
+
+   if (!memb)
+      return;
+
+   if (!reserve_scratch(memb))
+      return;
+
+   struct layout_hint *hints = plugin.scratch.hints;
+   struct wlc_geometry *geometries = plugin.scratch.geometries;
+   memset(hints, 0, memb * sizeof(struct layout_hint));
+
+   for (size_t i = 0; i < memb; ++i) {
+      const struct wlc_geometry *g;
+      if ((g = wlc_view_get_geometry(views[i])))
+         hints[i].current = *g;
+
+      struct view_info info;
+      hints[i].active = (get_view(views[i], &info) && (info.state & WLC_BIT_ACTIVATED));
+
+      // views the layout does not touch keep their geometry
+      geometries[i] = hints[i].current;
+   }
+
+   layout->function(region, views, hints, geometries, memb);
+
+   for (size_t i = 0; i < memb; ++i) {
+      const bool postpone = (!geometries[i].size.w && !geometries[i].size.h);
+      chck_hash_table_str_set(&plugin.configures.postponed_views, (const char*)&views[i], sizeof(views[i]), &postpone);
+
+      if (postpone) {
+         plugin.configures.postponed++;
+         continue;
+      }
+
+      geometries[i].size.w = chck_maxu32(geometries[i].size.w, hints[i].min.w);
+      geometries[i].size.h = chck_maxu32(geometries[i].size.h, hints[i].min.h);
+      set_view_state(views[i], WLC_BIT_MAXIMIZED, true);
+      set_view_geometry(views[i], 0, &geometries[i]);
+   }
 }
 
 static void
@@ -207,127 +537,219 @@ relayout(wlc_handle output)
    if (!(r = wlc_output_get_virtual_resolution(output)))
       return;
 
+   // only views of the visible space need work
    size_t memb;
-   const wlc_handle *views = wlc_output_get_views(output, &memb);
+   const uint32_t active = get_active_space(output);
+   const wlc_handle *views = get_space_views(output, active, &memb);
    for (size_t i = 0; i < memb; ++i) {
-      if (wlc_output_get_mask(output) != wlc_view_get_mask(views[i]))
+      struct view_info info;
+      if (!get_view(views[i], &info))
          continue;
 
-      if (wlc_view_get_type(views[i]) & BIT_BEMENU) {
+      if (info.type & BIT_BEMENU) {
          struct wlc_geometry g = *wlc_view_get_geometry(views[i]);
          g.origin = (struct wlc_point){ 0, 0 };
-         wlc_view_set_geometry(views[i], 0, &g);
+         set_view_geometry(views[i], 0, &g);
       }
 
-      if (wlc_view_get_state(views[i]) & WLC_BIT_FULLSCREEN)
-         wlc_view_set_geometry(views[i], 0, &(struct wlc_geometry){ { 0, 0 }, *r });
+      if (info.state & WLC_BIT_FULLSCREEN)
+         set_view_geometry(views[i], 0, &(struct wlc_geometry){ { 0, 0 }, *r });
 
-      if (wlc_view_get_type(views[i]) & WLC_BIT_SPLASH) {
+      if (info.type & WLC_BIT_SPLASH) {
          struct wlc_geometry g = *wlc_view_get_geometry(views[i]);
          g.origin = (struct wlc_point){ r->w * 0.5 - g.size.w * 0.5, r->h * 0.5 - g.size.h * 0.5 };
-         wlc_view_set_geometry(views[i], 0, &g);
+         set_view_geometry(views[i], 0, &g);
       }
 
-      wlc_handle parent;
-      if (is_managed(views[i]) && !is_popup(views[i]) && !is_or(views[i]) && (parent = wlc_view_get_parent(views[i])))
-         layout_parent(views[i], parent, &wlc_view_get_geometry(views[i])->size);
+      if (info_is_managed(&info) && !info_is_popup(&info) && !info_is_or(&info) && info.parent)
+         layout_parent(views[i], info.parent, &wlc_view_get_geometry(views[i])->size);
    }
 
+   struct space *space;
    struct layout *layout;
-   if ((layout = layout_for_output(output))) {
-      struct chck_iter_pool tiled = {{0}};
-      if (!chck_iter_pool(&tiled, memb, memb, sizeof(wlc_handle)))
-         return;
-
-      size_t memb;
-      const wlc_handle *views = wlc_output_get_mutable_views(output, &memb);
-      for (size_t i = 0; i < memb; ++i) {
-         if (is_tiled(views[i]) && wlc_output_get_mask(output) == wlc_view_get_mask(views[i])) {
-            wlc_view_set_state(views[i], WLC_BIT_MAXIMIZED, true);
-            chck_iter_pool_push_back(&tiled, &views[i]);
-         }
+   if ((layout = layout_for_output(output)) && (space = space_for(output, active, false))) {
+      // v2 layouts maximize only the views they configure
+      if (layout->legacy) {
+         const wlc_handle *v;
+         chck_iter_pool_for_each(&space->views, v)
+            set_view_state(*v, WLC_BIT_MAXIMIZED, true);
       }
 
-      layout->function(&(struct wlc_geometry){ { 0, 0 }, *r }, (void*)tiled.items.buffer, tiled.items.count);
-      chck_iter_pool_release(&tiled);
+      apply_layout(layout, &(struct wlc_geometry){ { 0, 0 }, *r }, (void*)space->views.items.buffer, space->views.items.count);
+   }
+}
+
+static bool
+is_dirty(wlc_handle output, size_t *out_index)
+{
+   const wlc_handle *o;
+   chck_iter_pool_for_each(&plugin.relayouts.dirty, o) {
+      if (*o != output)
+         continue;
+
+      if (out_index)
+         *out_index = _I - 1;
+
+      return true;
    }
+
+   return false;
+}
+
+static void
+relayout_now(wlc_handle output)
+{
+   size_t index;
+   if (is_dirty(output, &index))
+      chck_iter_pool_remove(&plugin.relayouts.dirty, index);
+
+   plugin.relayouts.stats.immediate++;
+   relayout(output);
+}
+
+static void
+schedule_relayout(wlc_handle output)
+{
+   if (!output)
+      return;
+
+   plugin.relayouts.stats.scheduled++;
+
+   if (is_dirty(output, NULL)) {
+      plugin.relayouts.stats.coalesced++;
+      return;
+   }
+
+   if (!plugin.relayouts.dirty.items.member && !chck_iter_pool(&plugin.relayouts.dirty, 4, 0, sizeof(wlc_handle)))
+      goto fallback;
+
+   if (!chck_iter_pool_push_back(&plugin.relayouts.dirty, &output))
+      goto fallback;
+
+   wlc_output_schedule_render(output);
+   return;
+
+fallback:
+   relayout_now(output);
+}
+
+static void
+output_pre_render(wlc_handle output)
+{
+   size_t index;
+   if (!is_dirty(output, &index))
+      return;
+
+   chck_iter_pool_remove(&plugin.relayouts.dirty, index);
+   plugin.relayouts.stats.deferred++;
+   relayout(output);
+}
+
+static void
+output_destroyed(wlc_handle output)
+{
+   size_t index;
+   if (is_dirty(output, &index))
+      chck_iter_pool_remove(&plugin.relayouts.dirty, index);
+
+   remove_spaces_for_output(output);
+}
+
+static bool
+view_created(wlc_handle view)
+{
+   update_view(view);
+   return true;
+}
+
+static void
+view_destroyed(wlc_handle view)
+{
+   const bool postpone = false;
+   chck_hash_table_str_set(&plugin.configures.postponed_views, (const char*)&view, sizeof(view), &postpone);
+   remove_view(view);
+}
+
+static void
+view_focus(wlc_handle view, bool focus)
+{
+   const bool *postponed;
+   if (!focus || !(postponed = chck_hash_table_str_get(&plugin.configures.postponed_views, (const char*)&view, sizeof(view))) || !*postponed)
+      return;
+
+   // Activated view was left unconfigured by lazy layout, it is sized now.
+   schedule_relayout(wlc_view_get_output(view));
+}
+
+static void
+view_move_to_output(wlc_handle view, wlc_handle from, wlc_handle to)
+{
+   (void)from, (void)to;
+   update_view(view);
 }
 
 static void
 output_resolution(wlc_handle output, const struct wlc_size *from, const struct wlc_size *to)
 {
    (void)output, (void)from, (void)to;
-   relayout(output);
+   schedule_relayout(output);
 }
 
 static void
 cycle_output(wlc_handle output, enum direction dir)
 {
-   size_t memb;
-   wlc_handle *views = wlc_output_get_mutable_views(output, &memb);
-   if (memb < 2)
+   struct space *s;
+   if (!(s = space_for(output, get_active_space(output), false)) || s->views.items.count < 2)
       return;
 
+   wlc_handle view;
    switch (dir) {
       case NEXT:
-      {
-         size_t last = NOTINDEX;
-         for (size_t i = 0; i < memb; ++i) {
-            if (!is_tiled(views[i]) || wlc_view_get_mask(views[i]) != wlc_output_get_mask(output))
-               continue;
-
-            if (last != NOTINDEX) {
-               wlc_handle tmp = views[last];
-               views[last] = views[i];
-               views[i] = tmp;
-            }
-
-            last = i;
-         }
-      }
-      break;
+         view = *(wlc_handle*)chck_iter_pool_get(&s->views, 0);
+         chck_iter_pool_remove(&s->views, 0);
+         chck_iter_pool_push_back(&s->views, &view);
+         break;
 
       case PREV:
-      {
-         size_t last = NOTINDEX;
-         for (size_t i = memb; i > 0; --i) {
-            if (!is_tiled(views[i - 1]) || wlc_view_get_mask(views[i - 1]) != wlc_output_get_mask(output))
-               continue;
-
-            if (last != NOTINDEX) {
-               wlc_handle tmp = views[last];
-               views[last] = views[i - 1];
-               views[i - 1] = tmp;
-            }
-
-            last = i - 1;
-         }
-      }
-      break;
+         view = *(wlc_handle*)chck_iter_pool_get_last(&s->views);
+         chck_iter_pool_remove(&s->views, s->views.items.count - 1);
+         chck_iter_pool_push_front(&s->views, &view);
+         break;
    }
-   relayout(output);
+
+   // Head of the list is the view cycled to, it goes on top.
+   // Lazy layouts only size the activated view, so head left unconfigured is focused to become visible.
+   const wlc_handle head = *(wlc_handle*)chck_iter_pool_get(&s->views, 0);
+   bring_to_front(head);
+
+   const bool *postponed;
+   if ((postponed = chck_hash_table_str_get(&plugin.configures.postponed_views, (const char*)&head, sizeof(head))) && *postponed)
+      wlc_view_focus(head);
+
+   schedule_relayout(output);
 }
 
 static void
 view_geometry_request(wlc_handle view, const struct wlc_geometry *geometry)
 {
-   const uint32_t type = wlc_view_get_type(view);
-   const uint32_t state = wlc_view_get_state(view);
-   const bool tiled = is_tiled(view);
-   const bool action = ((state & WLC_BIT_RESIZING) || (state & WLC_BIT_MOVING));
+   struct view_info info;
+   if (!get_view(view, &info))
+      return;
+
+   const bool tiled = info_is_tiled(&info);
+   const bool action = ((info.state & WLC_BIT_RESIZING) || (info.state & WLC_BIT_MOVING));
 
    if (tiled && !action)
       return;
 
    if (tiled)
-      wlc_view_set_state(view, WLC_BIT_MAXIMIZED, false);
+      set_state(view, WLC_BIT_MAXIMIZED, false);
 
-   if ((state & WLC_BIT_FULLSCREEN) || (type & WLC_BIT_SPLASH))
+   if ((info.state & WLC_BIT_FULLSCREEN) || (info.type & WLC_BIT_SPLASH))
       return;
 
-   wlc_handle parent;
-   if (is_managed(view) && !is_popup(view) && !is_or(view) && (parent = wlc_view_get_parent(view))) {
-      layout_parent(view, parent, &geometry->size);
+   if (info_is_managed(&info) && !info_is_popup(&info) && !info_is_or(&info) && info.parent) {
+      layout_parent(view, info.parent, &geometry->size);
    } else {
       wlc_view_set_geometry(view, 0, geometry);
    }
@@ -336,15 +758,16 @@ view_geometry_request(wlc_handle view, const struct wlc_geometry *geometry)
 static void
 view_state_request(wlc_handle view, const enum wlc_view_state_bit state, const bool toggle)
 {
-   wlc_view_set_state(view, state, toggle);
+   set_state(view, state, toggle);
+   update_view(view);
 
    switch (state) {
       case WLC_BIT_MAXIMIZED:
          if (toggle)
-            relayout(wlc_view_get_output(view));
+            schedule_relayout(wlc_view_get_output(view));
          break;
       case WLC_BIT_FULLSCREEN:
-         relayout(wlc_view_get_output(view));
+         schedule_relayout(wlc_view_get_output(view));
          break;
       default: break;
    }
@@ -362,7 +785,7 @@ key_cb_next_layout(wlc_handle view, uint32_t time, intptr_t arg)
 {
    (void)view, (void)time, (void)arg;
    next_layout(wlc_get_focused_output(), 1, NEXT);
-   relayout(wlc_get_focused_output());
+   schedule_relayout(wlc_get_focused_output());
 }
 
 static void
@@ -386,6 +809,15 @@ void
 plugin_deinit(plugin_h self)
 {
    (void)self;
+   plog(plugin.self, PLOG_INFO, "Relayouts: %" PRIu64 " scheduled, %" PRIu64 " coalesced, %" PRIu64 " deferred passes, %" PRIu64 " immediate passes",
+         plugin.relayouts.stats.scheduled, plugin.relayouts.stats.coalesced, plugin.relayouts.stats.deferred, plugin.relayouts.stats.immediate);
+   plog(plugin.self, PLOG_INFO, "Configures: %" PRIu64 " submitted, %" PRIu64 " avoided, %" PRIu64 " postponed",
+         plugin.configures.submitted, plugin.configures.avoided, plugin.configures.postponed);
+   chck_hash_table_release(&plugin.configures.postponed_views);
+   chck_iter_pool_release(&plugin.relayouts.dirty);
+   free(plugin.scratch.hints);
+   free(plugin.scratch.geometries);
+   remove_spaces();
    remove_layouts();
 }
 
@@ -394,30 +826,65 @@ plugin_init(plugin_h self)
 {
    plugin.self = self;
 
-   plugin_h orbment, keybind;
+   plugin_h orbment, keybind, cache, spaces;
    if (!(orbment = import_plugin(self, "orbment")) ||
-       !(keybind = import_plugin(self, "keybind")))
+       !(keybind = import_plugin(self, "keybind")) ||
+       !(cache = import_plugin(self, "view-cache")) ||
+       !(spaces = import_plugin(self, "spaces")))
       return false;
 
-   if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun)|1")) ||
-       !(add_keybind = import_method(self, keybind, "add_keybind", "b(h,c[],c*[],fun,ip)|1")))
+   if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun,i32)|1")) ||
+       !(add_keybind = import_method(self, keybind, "add_keybind", "b(h,c[],c*[],fun,ip)|1")) ||
+       !(get_view = import_method(self, cache, "get_view", "b(h,*)|1")) ||
+       !(set_state = import_method(self, cache, "set_state", "v(h,e,b)|1")) ||
+       !(get_root = import_method(self, cache, "get_root", "h(h)|1")) ||
+       !(bring_to_front = import_method(self, cache, "bring_to_front", "v(h)|1")) ||
+       !(get_space = import_method(self, spaces, "get_space", "u32(h)|1")) ||
+       !(get_active_space = import_method(self, spaces, "get_active_space", "u32(h)|1")) ||
+       !(get_space_views = import_method(self, spaces, "get_space_views", "*(h,u32,*)|1")))
       return false;
 
    for (size_t i = 0; keybinds[i].name; ++i)
       if (!add_keybind(self, keybinds[i].name, keybinds[i].syntax, FUN(keybinds[i].function, "v(h,u32,ip)|1"), 0))
          return false;
 
-   return (add_hook(self, "plugin.deloaded", FUN(plugin_deloaded, "v(h)|1")) &&
-           add_hook(self, "output.resolution", FUN(output_resolution, "v(h,*,*)|1")) &&
-           add_hook(self, "view.geometry_request", FUN(view_geometry_request, "v(h,*)|1")) &&
-           add_hook(self, "view.state_request", FUN(view_state_request, "v(h,e,b)|1")));
+   if (!chck_hash_table(&plugin.configures.postponed_views, 0, 256, sizeof(bool)) ||
+       !chck_hash_table(&plugin.tiling.members, 0, 256, sizeof(struct membership)))
+      return false;
+
+   size_t outputs;
+   const wlc_handle *o = wlc_get_outputs(&outputs);
+   for (size_t i = 0; i < outputs; ++i) {
+      size_t memb;
+      const wlc_handle *views = wlc_output_get_views(o[i], &memb);
+      for (size_t v = 0; v < memb; ++v)
+         update_view(views[v]);
+   }
+
+   // view.created runs late so type and space set by other plugins are seen.
+   return (add_hook(self, "plugin.deloaded", FUN(plugin_deloaded, "v(h)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "output.resolution", FUN(output_resolution, "v(h,*,*)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "output.destroyed", FUN(output_destroyed, "v(h)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "output.pre_render", FUN(output_pre_render, "v(h)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.created", FUN(view_created, "b(h)|1"), HOOK_PRIORITY_LOW) &&
+           add_hook(self, "view.destroyed", FUN(view_destroyed, "v(h)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.focus", FUN(view_focus, "v(h,b)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.move_to_output", FUN(view_move_to_output, "v(h,h,h)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.geometry_request", FUN(view_geometry_request, "v(h,*)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.state_request", FUN(view_state_request, "v(h,e,b)|1"), HOOK_PRIORITY_DEFAULT));
 }
 
+PLUGIN_INFO_VERSION_EXPORT;
+
 PCONST const struct plugin_info*
 plugin_register(void)
 {
    static const struct method methods[] = {
-      REGISTER_METHOD(relayout, "v(h)|1"),
+      REGISTER_METHOD_NAMED("relayout", relayout_now, "v(h)|1"),
+      REGISTER_METHOD(schedule_relayout, "v(h)|1"),
+      REGISTER_METHOD(set_view_geometry, "v(h,u32,*)|1"),
+      REGISTER_METHOD(set_view_state, "v(h,e,b)|1"),
+      REGISTER_METHOD(update_view, "v(h)|1"),
       REGISTER_METHOD(add_layout, "b(h,c[],fun)|1"),
       REGISTER_METHOD(remove_layout, "v(h,c[])|1"),
       {0},
@@ -425,6 +892,8 @@ plugin_register(void)
 
    static const char *requires[] = {
       "keybind",
+      "view-cache",
+      "spaces",
       NULL,
    };
 
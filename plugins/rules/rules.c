@@ -0,0 +1,447 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <orbment/plugin.h>
+#include <chck/pool/pool.h>
+#include <chck/lut/lut.h>
+#include <chck/string/string.h>
+#include "common.h"
+#include "config.h"
+
+/**
+ * Window rules, applied when view is created and before it is laid out.
+ *
+ * Rules are compiled once on load. Rule with an exact pattern is indexed by it in a hash table,
+ * so views are matched against those with a lookup per field. Only rules with nothing but glob
+ * patterns are tested one by one, and globs are split to literal segments beforehand.
+ */
+
+enum field {
+   FIELD_APP_ID,
+   FIELD_CLASS,
+   FIELD_TITLE,
+   FIELD_LAST,
+};
+
+enum action_bit {
+   ACTION_SPACE = 1<<0,
+   ACTION_OUTPUT = 1<<1,
+   ACTION_FLOATING = 1<<2,
+   ACTION_FULLSCREEN = 1<<3,
+   ACTION_FOCUS = 1<<4,
+};
+
+static const uint32_t NORULE = (uint32_t)-1;
+
+static const char *field_names[FIELD_LAST] = {
+   "app_id",
+   "class",
+   "title",
+};
+
+struct matcher {
+   // For globs, each '*' is replaced with NUL, leaving segments of literals and '?'.
+   struct chck_string pattern;
+   uint32_t segments;
+   bool glob;
+};
+
+struct actions {
+   uint32_t space, output;
+   uint32_t set; // mask of enum action_bit
+   bool floating, fullscreen, focus;
+};
+
+struct rule {
+   struct matcher match[FIELD_LAST];
+   struct actions actions;
+   // next rule indexed by same exact pattern
+   uint32_t next;
+};
+
+static bool (*add_hook)(plugin_h, const char *name, const struct function*, int32_t priority);
+static bool (*configuration_get)(const char *key, const char type, void *value_out);
+static void (*set_type)(wlc_handle view, uint32_t type, bool toggle);
+static void (*set_state)(wlc_handle view, enum wlc_view_state_bit state, bool toggle);
+static void (*set_output)(wlc_handle view, wlc_handle output);
+static void (*move_to_space)(wlc_handle view, uint32_t index);
+
+static struct {
+   struct chck_iter_pool rules;
+
+   // pattern -> index of first rule with the exact pattern, for each field
+   struct chck_hash_table exact[FIELD_LAST];
+
+   // rules with only glob patterns
+   struct chck_iter_pool globs;
+
+   // scratch for view_created
+   struct chck_iter_pool matched;
+
+   plugin_h self;
+} plugin;
+
+static void
+matcher_release(struct matcher *matcher)
+{
+   if (!matcher)
+      return;
+
+   chck_string_release(&matcher->pattern);
+}
+
+static void
+rule_release(struct rule *rule)
+{
+   if (!rule)
+      return;
+
+   for (uint32_t i = 0; i < FIELD_LAST; ++i)
+      matcher_release(&rule->match[i]);
+}
+
+static bool
+matcher_compile(struct matcher *matcher, const char *pattern)
+{
+   assert(matcher && pattern);
+
+   if (!chck_string_set_cstr(&matcher->pattern, pattern, true))
+      return false;
+
+   matcher->glob = (strpbrk(pattern, "*?") != NULL);
+   matcher->segments = 1;
+
+   for (char *s = matcher->pattern.data; (s = strchr(s, '*')); ++s, ++matcher->segments)
+      *s = 0;
+
+   return true;
+}
+
+static inline bool
+segment_eq(const char *str, const char *segment, size_t len)
+{
+   for (size_t i = 0; i < len; ++i) {
+      if (segment[i] != '?' && segment[i] != str[i])
+         return false;
+   }
+
+   return true;
+}
+
+/** Segments are matched leftmost first, which is enough when '*' is the only variable length token. */
+static bool
+glob_matches(const struct matcher *matcher, const char *str)
+{
+   const size_t size = strlen(str);
+   const char *segment = matcher->pattern.data;
+   size_t len = strlen(segment);
+
+   if (matcher->segments == 1)
+      return (len == size && segment_eq(str, segment, len));
+
+   // first segment is anchored to the start
+   if (len > size || !segment_eq(str, segment, len))
+      return false;
+
+   size_t pos = len;
+   for (uint32_t i = 1; i < matcher->segments - 1; ++i) {
+      segment += len + 1;
+      len = strlen(segment);
+
+      for (; pos + len <= size && !segment_eq(str + pos, segment, len); ++pos);
+
+      if (pos + len > size)
+         return false;
+
+      pos += len;
+   }
+
+   // last segment is anchored to the end
+   segment += len + 1;
+   len = strlen(segment);
+   return (pos + len <= size && segment_eq(str + size - len, segment, len));
+}
+
+static bool
+rule_matches(const struct rule *rule, const char *values[FIELD_LAST])
+{
+   for (uint32_t i = 0; i < FIELD_LAST; ++i) {
+      const struct matcher *m = &rule->match[i];
+
+      if (!m->pattern.data)
+         continue;
+
+      if (!values[i])
+         return false;
+
+      if (m->glob ? !glob_matches(m, values[i]) : !chck_cstreq(m->pattern.data, values[i]))
+         return false;
+   }
+
+   return true;
+}
+
+static bool
+load_rule(uint32_t index, struct rule *rule)
+{
+   assert(rule);
+
+   struct chck_string key = {0};
+   bool has_match = false;
+
+   for (uint32_t i = 0; i < FIELD_LAST; ++i) {
+      const char *pattern;
+      if (!chck_string_set_format(&key, "/rules/%u/%s", index, field_names[i]) || !configuration_get(key.data, 's', &pattern))
+         continue;
+
+      if (!matcher_compile(&rule->match[i], pattern))
+         goto error;
+
+      has_match = true;
+   }
+
+   if (!has_match)
+      goto error;
+
+   static const struct {
+      const char *name;
+      char type;
+      enum action_bit bit;
+      size_t offset;
+   } actions[] = {
+      { "space", 'u', ACTION_SPACE, offsetof(struct actions, space) },
+      { "output", 'u', ACTION_OUTPUT, offsetof(struct actions, output) },
+      { "floating", 'b', ACTION_FLOATING, offsetof(struct actions, floating) },
+      { "fullscreen", 'b', ACTION_FULLSCREEN, offsetof(struct actions, fullscreen) },
+      { "focus", 'b', ACTION_FOCUS, offsetof(struct actions, focus) },
+      { NULL, 0, 0, 0 },
+   };
+
+   for (uint32_t i = 0; actions[i].name; ++i) {
+      if (chck_string_set_format(&key, "/rules/%u/%s", index, actions[i].name) &&
+          configuration_get(key.data, actions[i].type, (uint8_t*)&rule->actions + actions[i].offset))
+         rule->actions.set |= actions[i].bit;
+   }
+
+   chck_string_release(&key);
+   return true;
+
+error:
+   chck_string_release(&key);
+   return false;
+}
+
+/** Indexes rule by its first exact pattern, or adds it to globs. */
+static bool
+index_rule(uint32_t index)
+{
+   struct rule *rule = chck_iter_pool_get(&plugin.rules, index);
+
+   for (uint32_t i = 0; i < FIELD_LAST; ++i) {
+      const struct matcher *m = &rule->match[i];
+      if (!m->pattern.data || m->glob)
+         continue;
+
+      const uint32_t *head = chck_hash_table_str_get(&plugin.exact[i], m->pattern.data, m->pattern.size);
+      rule->next = (head ? *head : NORULE);
+      return chck_hash_table_str_set(&plugin.exact[i], m->pattern.data, m->pattern.size, &index);
+   }
+
+   return chck_iter_pool_push_back(&plugin.globs, &index);
+}
+
+static bool
+load_rules(void)
+{
+   for (uint32_t i = 0; ; ++i) {
+      struct rule rule;
+      memset(&rule, 0, sizeof(rule));
+      rule.next = NORULE;
+
+      if (!load_rule(i, &rule)) {
+         rule_release(&rule);
+         break;
+      }
+
+      if (!chck_iter_pool_push_back(&plugin.rules, &rule)) {
+         rule_release(&rule);
+         return false;
+      }
+
+      if (!index_rule(plugin.rules.items.count - 1))
+         return false;
+   }
+
+   plog(plugin.self, PLOG_INFO, "Loaded %zu rules, %zu with only globs", plugin.rules.items.count, plugin.globs.items.count);
+   return true;
+}
+
+static int
+index_cmp(const void *a, const void *b)
+{
+   const uint32_t ia = *(const uint32_t*)a, ib = *(const uint32_t*)b;
+   return (ia > ib) - (ia < ib);
+}
+
+static wlc_handle
+output_for_index(uint32_t index)
+{
+   size_t memb;
+   const wlc_handle *outputs = wlc_get_outputs(&memb);
+   return (index < memb ? outputs[index] : 0);
+}
+
+static void
+apply_actions(wlc_handle view, const struct actions *actions)
+{
+   wlc_handle output;
+   if ((actions->set & ACTION_OUTPUT) && (output = output_for_index(actions->output)) && output != wlc_view_get_output(view))
+      set_output(view, output);
+
+   if (actions->set & ACTION_SPACE)
+      move_to_space(view, actions->space);
+
+   if (actions->set & ACTION_FLOATING)
+      set_type(view, BIT_FLOATING, actions->floating);
+
+   if (actions->set & ACTION_FULLSCREEN)
+      set_state(view, WLC_BIT_FULLSCREEN, actions->fullscreen);
+
+   if (actions->set & ACTION_FOCUS)
+      set_type(view, BIT_NOFOCUS, !actions->focus);
+}
+
+static bool
+view_created(wlc_handle view)
+{
+   if (!plugin.rules.items.count)
+      return true;
+
+   const char *values[FIELD_LAST] = {
+      wlc_view_get_app_id(view),
+      wlc_view_get_class(view),
+      wlc_view_get_title(view),
+   };
+
+   for (uint32_t i = 0; i < FIELD_LAST; ++i) {
+      const uint32_t *head;
+      if (chck_cstr_is_empty(values[i]) || !(head = chck_hash_table_str_get(&plugin.exact[i], values[i], strlen(values[i]))))
+         continue;
+
+      for (uint32_t r = *head; r != NORULE; r = ((struct rule*)chck_iter_pool_get(&plugin.rules, r))->next) {
+         if (rule_matches(chck_iter_pool_get(&plugin.rules, r), values))
+            chck_iter_pool_push_back(&plugin.matched, &r);
+      }
+   }
+
+   const uint32_t *g;
+   chck_iter_pool_for_each(&plugin.globs, g) {
+      if (rule_matches(chck_iter_pool_get(&plugin.rules, *g), values))
+         chck_iter_pool_push_back(&plugin.matched, g);
+   }
+
+   if (!plugin.matched.items.count)
+      return true;
+
+   // Later rules override earlier ones
+   qsort(plugin.matched.items.buffer, plugin.matched.items.count, sizeof(uint32_t), index_cmp);
+
+   struct actions merged = {0};
+   const uint32_t *m;
+   chck_iter_pool_for_each(&plugin.matched, m) {
+      const struct actions *a = &((struct rule*)chck_iter_pool_get(&plugin.rules, *m))->actions;
+      merged.space = (a->set & ACTION_SPACE ? a->space : merged.space);
+      merged.output = (a->set & ACTION_OUTPUT ? a->output : merged.output);
+      merged.floating = (a->set & ACTION_FLOATING ? a->floating : merged.floating);
+      merged.fullscreen = (a->set & ACTION_FULLSCREEN ? a->fullscreen : merged.fullscreen);
+      merged.focus = (a->set & ACTION_FOCUS ? a->focus : merged.focus);
+      merged.set |= a->set;
+   }
+
+   chck_iter_pool_empty(&plugin.matched);
+   apply_actions(view, &merged);
+   return true;
+}
+
+static void
+compositor_ready(void)
+{
+   // configuration backend may load after us, so the rules are compiled once it surely has
+   if (!load_rules())
+      plog(plugin.self, PLOG_ERROR, "Could not load rules");
+}
+
+#pragma GCC diagnostic ignored "-Wmissing-prototypes"
+
+void
+plugin_deinit(plugin_h self)
+{
+   (void)self;
+
+   for (uint32_t i = 0; i < FIELD_LAST; ++i)
+      chck_hash_table_release(&plugin.exact[i]);
+
+   chck_iter_pool_for_each_call(&plugin.rules, rule_release);
+   chck_iter_pool_release(&plugin.rules);
+   chck_iter_pool_release(&plugin.globs);
+   chck_iter_pool_release(&plugin.matched);
+}
+
+bool
+plugin_init(plugin_h self)
+{
+   plugin.self = self;
+
+   plugin_h orbment, configuration, cache, spaces;
+   if (!(orbment = import_plugin(self, "orbment")) ||
+       !(configuration = import_plugin(self, "configuration")) ||
+       !(cache = import_plugin(self, "view-cache")) ||
+       !(spaces = import_plugin(self, "spaces")))
+      return false;
+
+   if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun,i32)|1")) ||
+       !(configuration_get = import_method(self, configuration, "get", "b(c[],c,v)|1")) ||
+       !(set_type = import_method(self, cache, "set_type", "v(h,u32,b)|1")) ||
+       !(set_state = import_method(self, cache, "set_state", "v(h,e,b)|1")) ||
+       !(set_output = import_method(self, cache, "set_output", "v(h,h)|1")) ||
+       !(move_to_space = import_method(self, spaces, "move_to_space", "v(h,u32)|1")))
+      return false;
+
+   if (!chck_iter_pool(&plugin.rules, 8, 0, sizeof(struct rule)) ||
+       !chck_iter_pool(&plugin.globs, 8, 0, sizeof(uint32_t)) ||
+       !chck_iter_pool(&plugin.matched, 8, 0, sizeof(uint32_t)))
+      return false;
+
+   for (uint32_t i = 0; i < FIELD_LAST; ++i) {
+      if (!chck_hash_table(&plugin.exact[i], 0, 64, sizeof(uint32_t)))
+         return false;
+   }
+
+   // Rules run after spaces has placed the view (HOOK_PRIORITY_HIGH), but before anything focuses or lays it out.
+   // Same priority would leave the order to plugin init order, which parallel init does not keep.
+   return (add_hook(self, "compositor.ready", FUN(compositor_ready, "v(v)|1"), HOOK_PRIORITY_DEFAULT) &&
+           add_hook(self, "view.created", FUN(view_created, "b(h)|1"), HOOK_PRIORITY_HIGH - 1));
+}
+
+PLUGIN_INFO_VERSION_EXPORT;
+
+PCONST const struct plugin_info*
+plugin_register(void)
+{
+   static const char *requires[] = {
+      "configuration",
+      "view-cache",
+      "spaces",
+      NULL,
+   };
+
+   static const struct plugin_info info = {
+      .name = "rules",
+      .description = "Window rules.",
+      .version = VERSION,
+      .requires = requires,
+   };
+
+   return &info;
+}
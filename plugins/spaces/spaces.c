@@ -0,0 +1,441 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <orbment/plugin.h>
+#include <chck/pool/pool.h>
+#include <chck/lut/lut.h>
+#include <chck/string/string.h>
+#include "common.h"
+#include "config.h"
+
+/**
+ * Spaces of outputs with explicit view membership.
+ *
+ * wlc only shows views whose mask shares a bit with the output mask. Outputs always have SPACE_VISIBLE,
+ * and views of the active space are the only ones having it too. Switching spaces touches only the
+ * views leaving and entering, and there is no limit on the number of spaces.
+ *
+ * Members of a space are kept in stacking order, topmost last, so walking the views of a space
+ * does not need the stacking order of the whole output. Views are raised through view-cache.
+ */
+
+enum {
+   SPACE_VISIBLE = 1<<0,
+};
+
+// Spaces every output starts with, more are created on demand.
+static const uint32_t DEFAULT_SPACES = 10;
+
+static const uint32_t NOSPACE = (uint32_t)-1;
+
+static bool (*add_hook)(plugin_h, const char *name, const struct function*, int32_t priority);
+static void (*set_mask)(wlc_handle view, uint32_t mask);
+static bool (*add_raise_listener)(plugin_h, const struct function*);
+
+struct space {
+   struct chck_string name;
+   // members in stacking order, topmost last, views join on top
+   struct chck_iter_pool views;
+};
+
+struct spaces {
+   struct chck_iter_pool spaces;
+   wlc_handle output;
+   uint32_t active;
+};
+
+struct membership {
+   wlc_handle output;
+   uint32_t index;
+   bool valid;
+};
+
+static struct {
+   // there is usually only few outputs, linear search is fine.
+   struct chck_iter_pool outputs;
+
+   // view -> struct membership
+   struct chck_hash_table members;
+
+   plugin_h self;
+} plugin;
+
+static struct spaces*
+spaces_for_output(wlc_handle output)
+{
+   struct spaces *s;
+   chck_iter_pool_for_each(&plugin.outputs, s) {
+      if (s->output == output)
+         return s;
+   }
+
+   return NULL;
+}
+
+static void
+space_release(struct space *space)
+{
+   if (!space)
+      return;
+
+   chck_string_release(&space->name);
+   chck_iter_pool_release(&space->views);
+}
+
+static struct space*
+space_for(wlc_handle output, uint32_t index, bool create)
+{
+   struct spaces *s;
+   if (!(s = spaces_for_output(output)))
+      return NULL;
+
+   if (index < s->spaces.items.count)
+      return chck_iter_pool_get(&s->spaces, index);
+
+   if (!create || index == NOSPACE)
+      return NULL;
+
+   while (s->spaces.items.count <= index) {
+      struct space space;
+      memset(&space, 0, sizeof(space));
+      if (!chck_iter_pool(&space.views, 8, 0, sizeof(wlc_handle)))
+         return NULL;
+
+      if (!chck_string_set_format(&space.name, "%zu", s->spaces.items.count + 1) || !chck_iter_pool_push_back(&s->spaces, &space)) {
+         space_release(&space);
+         return NULL;
+      }
+   }
+
+   return chck_iter_pool_get(&s->spaces, index);
+}
+
+static struct membership*
+membership_for(wlc_handle view)
+{
+   struct membership *m;
+   if (!plugin.members.lut.table || !(m = chck_hash_table_str_get(&plugin.members, (const char*)&view, sizeof(view))) || !m->valid)
+      return NULL;
+
+   return m;
+}
+
+static bool
+remove_member(struct space *space, wlc_handle view)
+{
+   const wlc_handle *v;
+   chck_iter_pool_for_each(&space->views, v) {
+      if (*v != view)
+         continue;
+
+      chck_iter_pool_remove(&space->views, _I - 1);
+      return true;
+   }
+
+   return false;
+}
+
+static void
+leave_space(wlc_handle view)
+{
+   struct membership *m;
+   if (!(m = membership_for(view)))
+      return;
+
+   struct space *space;
+   if ((space = space_for(m->output, m->index, false)))
+      remove_member(space, view);
+
+   m->valid = false;
+}
+
+static bool
+join_space(wlc_handle view, wlc_handle output, uint32_t index)
+{
+   leave_space(view);
+
+   struct spaces *s;
+   struct space *space;
+   if (!(s = spaces_for_output(output)) || !(space = space_for(output, index, true)))
+      return false;
+
+   const struct membership m = {
+      .output = output,
+      .index = index,
+      .valid = true,
+   };
+
+   if (!chck_hash_table_str_set(&plugin.members, (const char*)&view, sizeof(view), &m))
+      return false;
+
+   if (!chck_iter_pool_push_back(&space->views, &view)) {
+      leave_space(view);
+      return false;
+   }
+
+   set_mask(view, (index == s->active ? SPACE_VISIBLE : 0));
+   return true;
+}
+
+static uint32_t
+get_space(wlc_handle view)
+{
+   const struct membership *m;
+   return ((m = membership_for(view)) ? m->index : NOSPACE);
+}
+
+static uint32_t
+get_active_space(wlc_handle output)
+{
+   const struct spaces *s;
+   return ((s = spaces_for_output(output)) ? s->active : NOSPACE);
+}
+
+static uint32_t
+get_space_count(wlc_handle output)
+{
+   const struct spaces *s;
+   return ((s = spaces_for_output(output)) ? s->spaces.items.count : 0);
+}
+
+static const wlc_handle*
+get_space_views(wlc_handle output, uint32_t index, size_t *out_memb)
+{
+   if (!out_memb)
+      return NULL;
+
+   struct space *space;
+   if (!(space = space_for(output, index, false))) {
+      *out_memb = 0;
+      return NULL;
+   }
+
+   *out_memb = space->views.items.count;
+   return (void*)space->views.items.buffer;
+}
+
+static const char*
+get_space_name(wlc_handle output, uint32_t index)
+{
+   const struct space *space;
+   return ((space = space_for(output, index, false)) ? space->name.data : NULL);
+}
+
+static bool
+set_space_name(wlc_handle output, uint32_t index, const char *name)
+{
+   struct space *space;
+   if (chck_cstr_is_empty(name) || !(space = space_for(output, index, true)))
+      return false;
+
+   return chck_string_set_cstr(&space->name, name, true);
+}
+
+static void
+focus_space(wlc_handle output, uint32_t index)
+{
+   struct spaces *s;
+   struct space *space;
+   if (!(s = spaces_for_output(output)) || s->active == index || !(space = space_for(output, index, true)))
+      return;
+
+   const wlc_handle *v;
+   struct space *old;
+   if ((old = space_for(output, s->active, false))) {
+      chck_iter_pool_for_each(&old->views, v)
+         set_mask(*v, 0);
+   }
+
+   chck_iter_pool_for_each(&space->views, v)
+      set_mask(*v, SPACE_VISIBLE);
+
+   s->active = index;
+   plog(plugin.self, PLOG_DEBUG, "Output %" PRIuWLC " space %s", output, space->name.data);
+}
+
+static void
+move_to_space(wlc_handle view, uint32_t index)
+{
+   const wlc_handle output = wlc_view_get_output(view);
+   if (get_space(view) != index)
+      join_space(view, output, index);
+}
+
+static bool
+add_output(wlc_handle output)
+{
+   if (spaces_for_output(output))
+      return true;
+
+   if (!plugin.outputs.items.member && !chck_iter_pool(&plugin.outputs, 4, 0, sizeof(struct spaces)))
+      return false;
+
+   struct spaces spaces = {
+      .output = output,
+   };
+
+   if (!chck_iter_pool(&spaces.spaces, DEFAULT_SPACES, 0, sizeof(struct space)) || !chck_iter_pool_push_back(&plugin.outputs, &spaces)) {
+      chck_iter_pool_release(&spaces.spaces);
+      return false;
+   }
+
+   space_for(output, DEFAULT_SPACES - 1, true);
+   wlc_output_set_mask(output, SPACE_VISIBLE);
+   return true;
+}
+
+static void
+spaces_release(struct spaces *spaces)
+{
+   if (!spaces)
+      return;
+
+   chck_iter_pool_for_each_call(&spaces->spaces, space_release);
+   chck_iter_pool_release(&spaces->spaces);
+}
+
+static bool
+output_created(wlc_handle output)
+{
+   return add_output(output);
+}
+
+static void
+output_destroyed(wlc_handle output)
+{
+   struct spaces *s;
+   chck_iter_pool_for_each(&plugin.outputs, s) {
+      if (s->output != output)
+         continue;
+
+      const struct space *space;
+      chck_iter_pool_for_each(&s->spaces, space) {
+         const wlc_handle *v;
+         chck_iter_pool_for_each(&space->views, v) {
+            struct membership *m;
+            if ((m = membership_for(*v)))
+               m->valid = false;
+         }
+      }
+
+      spaces_release(s);
+      chck_iter_pool_remove(&plugin.outputs, _I - 1);
+      break;
+   }
+}
+
+static bool
+view_created(wlc_handle view)
+{
+   const wlc_handle output = wlc_view_get_output(view);
+   join_space(view, output, get_active_space(output));
+   return true;
+}
+
+static void
+view_destroyed(wlc_handle view)
+{
+   leave_space(view);
+}
+
+static void
+view_raised(wlc_handle view)
+{
+   const struct membership *m;
+   struct space *space;
+   if (!(m = membership_for(view)) || !(space = space_for(m->output, m->index, false)))
+      return;
+
+   if (remove_member(space, view))
+      chck_iter_pool_push_back(&space->views, &view);
+}
+
+static void
+view_move_to_output(wlc_handle view, wlc_handle from, wlc_handle to)
+{
+   (void)from;
+   join_space(view, to, get_active_space(to));
+}
+
+#pragma GCC diagnostic ignored "-Wmissing-prototypes"
+
+void
+plugin_deinit(plugin_h self)
+{
+   (void)self;
+   chck_iter_pool_for_each_call(&plugin.outputs, spaces_release);
+   chck_iter_pool_release(&plugin.outputs);
+   chck_hash_table_release(&plugin.members);
+}
+
+bool
+plugin_init(plugin_h self)
+{
+   plugin.self = self;
+
+   plugin_h orbment, cache;
+   if (!(orbment = import_plugin(self, "orbment")) ||
+       !(cache = import_plugin(self, "view-cache")))
+      return false;
+
+   if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun,i32)|1")) ||
+       !(set_mask = import_method(self, cache, "set_mask", "v(h,u32)|1")) ||
+       !(add_raise_listener = import_method(self, cache, "add_raise_listener", "b(h,fun)|1")))
+      return false;
+
+   if (!chck_hash_table(&plugin.members, 0, 256, sizeof(struct membership)))
+      return false;
+
+   size_t outputs;
+   const wlc_handle *o = wlc_get_outputs(&outputs);
+   for (size_t i = 0; i < outputs; ++i) {
+      if (!add_output(o[i]))
+         return false;
+
+      size_t memb;
+      const wlc_handle *views = wlc_output_get_views(o[i], &memb);
+      for (size_t v = 0; v < memb; ++v)
+         join_space(views[v], o[i], 0);
+   }
+
+   // Views and outputs join spaces before other plugins see them.
+   return (add_raise_listener(self, FUN(view_raised, "v(h)|1")) &&
+           add_hook(self, "output.created", FUN(output_created, "b(h)|1"), HOOK_PRIORITY_HIGH) &&
+           add_hook(self, "output.destroyed", FUN(output_destroyed, "v(h)|1"), HOOK_PRIORITY_LOW) &&
+           add_hook(self, "view.created", FUN(view_created, "b(h)|1"), HOOK_PRIORITY_HIGH) &&
+           add_hook(self, "view.destroyed", FUN(view_destroyed, "v(h)|1"), HOOK_PRIORITY_LOW) &&
+           add_hook(self, "view.move_to_output", FUN(view_move_to_output, "v(h,h,h)|1"), HOOK_PRIORITY_HIGH));
+}
+
+PLUGIN_INFO_VERSION_EXPORT;
+
+PCONST const struct plugin_info*
+plugin_register(void)
+{
+   static const struct method methods[] = {
+      REGISTER_METHOD(focus_space, "v(h,u32)|1"),
+      REGISTER_METHOD(move_to_space, "v(h,u32)|1"),
+      REGISTER_METHOD(get_space, "u32(h)|1"),
+      REGISTER_METHOD(get_active_space, "u32(h)|1"),
+      REGISTER_METHOD(get_space_count, "u32(h)|1"),
+      REGISTER_METHOD(get_space_views, "*(h,u32,*)|1"),
+      REGISTER_METHOD(get_space_name, "c[](h,u32)|1"),
+      REGISTER_METHOD(set_space_name, "b(h,u32,c[])|1"),
+      {0},
+   };
+
+   static const char *requires[] = {
+      "view-cache",
+      NULL,
+   };
+
+   static const struct plugin_info info = {
+      .name = "spaces",
+      .description = "Spaces of outputs.",
+      .version = VERSION,
+      .methods = methods,
+      .requires = requires,
+   };
+
+   return &info;
+}
@@ -0,0 +1,629 @@
+#include <stdlib.h>
+#include <string.h>
+#include <orbment/plugin.h>
+#include <chck/pool/pool.h>
+#include <chck/lut/lut.h>
+#include <chck/overflow/overflow.h>
+#include <chck/string/string.h>
+#include "common.h"
+#include "config.h"
+
+/**
+ * Mirrors type, state, mask and output of views so plugins do not have to ask wlc for them over and over.
+ * Changes made through wlc directly are not seen, use the setters exported here instead.
+ *
+ * Also indexes parent -> children, children of a view are kept in stacking order when raised with bring_to_front.
+ * Clients can change parent without telling the compositor, so parent is checked against wlc whenever
+ * a view is asked for or requests state or geometry, and children that moved away are dropped on mismatch.
+ *
+ * Fullscreen views are kept in the order they were raised with bring_to_front, so the topmost one
+ * of an output is found without walking every view of it.
+ * Plugins keeping their own stacking order are told about raises with add_raise_listener.
+ */
+
+static const size_t NOTINDEX = (size_t)-1;
+
+static bool (*add_hook)(plugin_h, const char *name, const struct function*, int32_t priority);
+
+typedef void (*raise_fun_t)(wlc_handle view);
+
+struct raise_listener {
+   raise_fun_t function;
+   plugin_h owner;
+};
+
+static struct {
+   struct {
+      // structure of arrays, slot i describes handles[i]
+      // queries only touch the arrays they filter on.
+      wlc_handle *handles, *outputs, *parents;
+      uint32_t *types, *states, *masks;
+      struct chck_iter_pool *children;
+      size_t count, allocated;
+   } views;
+
+   // view -> slot + 1, 0 when view is not cached
+   struct chck_hash_table slots;
+
+   // result of last get_tiled_views
+   struct chck_iter_pool query;
+
+   // result of last get_children
+   struct chck_iter_pool family;
+
+   // fullscreen views of all outputs, topmost last
+   struct chck_iter_pool fullscreen;
+
+   // struct raise_listener, called after bring_to_front
+   struct chck_iter_pool listeners;
+
+   plugin_h self;
+} plugin;
+
+static size_t
+slot_for(wlc_handle view)
+{
+   const size_t *slot;
+   if (!plugin.slots.lut.table || !(slot = chck_hash_table_str_get(&plugin.slots, (const char*)&view, sizeof(view))) || !*slot)
+      return NOTINDEX;
+
+   return *slot - 1;
+}
+
+static bool
+set_slot(wlc_handle view, size_t slot)
+{
+   const size_t value = (slot != NOTINDEX ? slot + 1 : 0);
+   return chck_hash_table_str_set(&plugin.slots, (const char*)&view, sizeof(view), &value);
+}
+
+static bool
+grow(void)
+{
+   const size_t allocated = (plugin.views.allocated ? plugin.views.allocated * 2 : 32);
+
+   void *tmp;
+#define GROW(x) \
+   if (!(tmp = chck_realloc_mul_of(plugin.views.x, allocated, sizeof(*plugin.views.x)))) \
+      return false; \
+   plugin.views.x = tmp;
+
+   GROW(handles);
+   GROW(outputs);
+   GROW(parents);
+   GROW(children);
+   GROW(types);
+   GROW(states);
+   GROW(masks);
+#undef GROW
+
+   plugin.views.allocated = allocated;
+   return true;
+}
+
+static void
+track_fullscreen(wlc_handle view, bool fullscreen)
+{
+   const wlc_handle *v;
+   chck_iter_pool_for_each(&plugin.fullscreen, v) {
+      if (*v != view)
+         continue;
+
+      if (!fullscreen)
+         chck_iter_pool_remove(&plugin.fullscreen, _I - 1);
+
+      return;
+   }
+
+   if (fullscreen)
+      chck_iter_pool_push_back(&plugin.fullscreen, &view);
+}
+
+static void
+read_view(size_t slot)
+{
+   const wlc_handle view = plugin.views.handles[slot];
+   plugin.views.outputs[slot] = wlc_view_get_output(view);
+   plugin.views.types[slot] = wlc_view_get_type(view);
+   plugin.views.states[slot] = wlc_view_get_state(view);
+   plugin.views.masks[slot] = wlc_view_get_mask(view);
+   track_fullscreen(view, (plugin.views.states[slot] & WLC_BIT_FULLSCREEN));
+}
+
+static size_t cache_view(wlc_handle view);
+
+static void
+unlink_parent(size_t slot)
+{
+   size_t p;
+   const wlc_handle view = plugin.views.handles[slot];
+   if (plugin.views.parents[slot] && (p = slot_for(plugin.views.parents[slot])) != NOTINDEX) {
+      const wlc_handle *c;
+      struct chck_iter_pool *children = &plugin.views.children[p];
+      chck_iter_pool_for_each(children, c) {
+         if (*c != view)
+            continue;
+
+         chck_iter_pool_remove(children, _I - 1);
+         break;
+      }
+   }
+
+   plugin.views.parents[slot] = 0;
+}
+
+static void
+link_parent(wlc_handle view, wlc_handle parent)
+{
+   size_t slot;
+   if ((slot = slot_for(view)) == NOTINDEX || plugin.views.parents[slot] == parent)
+      return;
+
+   unlink_parent(slot);
+
+   // may grow the arrays, but slot of view stays
+   size_t p;
+   if (!parent || (p = cache_view(parent)) == NOTINDEX)
+      return;
+
+   struct chck_iter_pool *children = &plugin.views.children[p];
+   if (!children->items.member && !chck_iter_pool(children, 4, 0, sizeof(wlc_handle)))
+      return;
+
+   if (chck_iter_pool_push_back(children, &view))
+      plugin.views.parents[slot] = parent;
+}
+
+static size_t
+check_parent(wlc_handle view)
+{
+   size_t slot;
+   if ((slot = cache_view(view)) == NOTINDEX)
+      return NOTINDEX;
+
+   const wlc_handle parent = wlc_view_get_parent(view);
+   if (plugin.views.parents[slot] != parent)
+      link_parent(view, parent);
+
+   return slot;
+}
+
+static size_t
+cache_view(wlc_handle view)
+{
+   if (!view)
+      return NOTINDEX;
+
+   size_t slot;
+   if ((slot = slot_for(view)) != NOTINDEX)
+      return slot;
+
+   if (plugin.views.count >= plugin.views.allocated && !grow())
+      return NOTINDEX;
+
+   slot = plugin.views.count;
+   if (!set_slot(view, slot))
+      return NOTINDEX;
+
+   plugin.views.handles[slot] = view;
+   plugin.views.parents[slot] = 0;
+   memset(&plugin.views.children[slot], 0, sizeof(plugin.views.children[slot]));
+   read_view(slot);
+   plugin.views.count++;
+   link_parent(view, wlc_view_get_parent(view));
+   return slot;
+}
+
+static void
+uncache_view(wlc_handle view)
+{
+   size_t slot;
+   if ((slot = slot_for(view)) == NOTINDEX)
+      return;
+
+   unlink_parent(slot);
+   track_fullscreen(view, false);
+
+   const wlc_handle *c;
+   chck_iter_pool_for_each(&plugin.views.children[slot], c) {
+      size_t s;
+      if ((s = slot_for(*c)) != NOTINDEX)
+         plugin.views.parents[s] = 0;
+   }
+
+   chck_iter_pool_release(&plugin.views.children[slot]);
+   set_slot(view, NOTINDEX);
+
+   // keep arrays dense, move last view to the hole
+   const size_t last = --plugin.views.count;
+   if (slot == last)
+      return;
+
+   plugin.views.handles[slot] = plugin.views.handles[last];
+   plugin.views.outputs[slot] = plugin.views.outputs[last];
+   plugin.views.parents[slot] = plugin.views.parents[last];
+   plugin.views.children[slot] = plugin.views.children[last];
+   plugin.views.types[slot] = plugin.views.types[last];
+   plugin.views.states[slot] = plugin.views.states[last];
+   plugin.views.masks[slot] = plugin.views.masks[last];
+   set_slot(plugin.views.handles[slot], slot);
+}
+
+static void
+refresh_view(wlc_handle view)
+{
+   size_t slot;
+   if ((slot = slot_for(view)) != NOTINDEX) {
+      read_view(slot);
+      check_parent(view);
+   } else {
+      cache_view(view);
+   }
+}
+
+static bool
+get_view(wlc_handle view, struct view_info *out_info)
+{
+   size_t slot;
+   if (!out_info || (slot = check_parent(view)) == NOTINDEX)
+      return false;
+
+   *out_info = (struct view_info){
+      .output = plugin.views.outputs[slot],
+      .parent = plugin.views.parents[slot],
+      .type = plugin.views.types[slot],
+      .state = plugin.views.states[slot],
+      .mask = plugin.views.masks[slot],
+   };
+
+   return true;
+}
+
+static void
+set_state(wlc_handle view, enum wlc_view_state_bit state, bool toggle)
+{
+   wlc_view_set_state(view, state, toggle);
+
+   size_t slot;
+   if ((slot = cache_view(view)) == NOTINDEX)
+      return;
+
+   plugin.views.states[slot] = (toggle ? plugin.views.states[slot] | state : plugin.views.states[slot] & ~state);
+   track_fullscreen(view, (plugin.views.states[slot] & WLC_BIT_FULLSCREEN));
+}
+
+static void
+set_type(wlc_handle view, uint32_t type, bool toggle)
+{
+   wlc_view_set_type(view, type, toggle);
+
+   size_t slot;
+   if ((slot = cache_view(view)) != NOTINDEX)
+      plugin.views.types[slot] = (toggle ? plugin.views.types[slot] | type : plugin.views.types[slot] & ~type);
+}
+
+static void
+set_mask(wlc_handle view, uint32_t mask)
+{
+   wlc_view_set_mask(view, mask);
+
+   size_t slot;
+   if ((slot = cache_view(view)) != NOTINDEX)
+      plugin.views.masks[slot] = mask;
+}
+
+static void
+set_output(wlc_handle view, wlc_handle output)
+{
+   wlc_view_set_output(view, output);
+
+   size_t slot;
+   if ((slot = cache_view(view)) != NOTINDEX)
+      plugin.views.outputs[slot] = wlc_view_get_output(view);
+}
+
+static void
+set_parent(wlc_handle view, wlc_handle parent)
+{
+   wlc_view_set_parent(view, parent);
+
+   if (cache_view(view) != NOTINDEX)
+      link_parent(view, wlc_view_get_parent(view));
+}
+
+/**
+ * Children of view, topmost last.
+ * Returned array is valid until next call.
+ */
+static const wlc_handle*
+get_children(wlc_handle view, size_t *out_memb)
+{
+   if (!out_memb)
+      return NULL;
+
+   *out_memb = 0;
+   chck_iter_pool_flush(&plugin.family);
+
+   size_t slot;
+   if ((slot = cache_view(view)) == NOTINDEX)
+      return NULL;
+
+   const wlc_handle *c;
+   struct chck_iter_pool *children = &plugin.views.children[slot];
+   chck_iter_pool_for_each(children, c) {
+      if (wlc_view_get_parent(*c) == view) {
+         if (!chck_iter_pool_push_back(&plugin.family, c))
+            return NULL;
+
+         continue;
+      }
+
+      // reparented behind our back
+      const wlc_handle child = *c;
+      chck_iter_pool_remove(children, _I - 1);
+      --_I;
+
+      size_t s;
+      if ((s = slot_for(child)) != NOTINDEX && plugin.views.parents[s] == view) {
+         plugin.views.parents[s] = 0;
+         link_parent(child, wlc_view_get_parent(child));
+         children = &plugin.views.children[slot];
+      }
+   }
+
+   *out_memb = plugin.family.items.count;
+   return (void*)plugin.family.items.buffer;
+}
+
+static wlc_handle
+get_root(wlc_handle view)
+{
+   size_t slot;
+   while ((slot = check_parent(view)) != NOTINDEX && plugin.views.parents[slot])
+      view = plugin.views.parents[slot];
+
+   return view;
+}
+
+static bool
+add_raise_listener(plugin_h caller, const struct function *fun)
+{
+   static const char *signature = "v(h)|1";
+
+   if (!caller || !fun)
+      return false;
+
+   if (!chck_cstreq(fun->signature, signature)) {
+      plog(plugin.self, PLOG_WARN, "Wrong signature provided for raise listener. (%s != %s)", signature, fun->signature);
+      return false;
+   }
+
+   const struct raise_listener listener = {
+      .function = fun->function,
+      .owner = caller,
+   };
+
+   return chck_iter_pool_push_back(&plugin.listeners, &listener);
+}
+
+static void
+bring_to_front(wlc_handle view)
+{
+   wlc_view_bring_to_front(view);
+
+   const struct raise_listener *l;
+   chck_iter_pool_for_each(&plugin.listeners, l)
+      l->function(view);
+
+   size_t slot;
+   if ((slot = slot_for(view)) != NOTINDEX && (plugin.views.states[slot] & WLC_BIT_FULLSCREEN)) {
+      track_fullscreen(view, false);
+      track_fullscreen(view, true);
+   }
+
+   size_t p;
+   if ((slot = check_parent(view)) == NOTINDEX || !plugin.views.parents[slot] || (p = slot_for(plugin.views.parents[slot])) == NOTINDEX)
+      return;
+
+   // keep children in stacking order
+   struct chck_iter_pool *children = &plugin.views.children[p];
+   const wlc_handle *c;
+   chck_iter_pool_for_each(children, c) {
+      if (*c != view)
+         continue;
+
+      chck_iter_pool_remove(children, _I - 1);
+      chck_iter_pool_push_back(children, &view);
+      break;
+   }
+}
+
+/**
+ * Topmost fullscreen view on output, or 0.
+ */
+static wlc_handle
+get_fullscreen(wlc_handle output)
+{
+   const wlc_handle *views = plugin.fullscreen.items.buffer;
+   for (size_t i = plugin.fullscreen.items.count; i > 0; --i) {
+      size_t slot;
+      if ((slot = slot_for(views[i - 1])) != NOTINDEX && plugin.views.outputs[slot] == output)
+         return views[i - 1];
+   }
+
+   return 0;
+}
+
+static const wlc_handle*
+get_tiled_views(wlc_handle output, uint32_t mask, size_t *out_memb)
+{
+   if (!out_memb)
+      return NULL;
+
+   *out_memb = 0;
+   chck_iter_pool_flush(&plugin.query);
+
+   for (size_t i = 0; i < plugin.views.count; ++i) {
+      if (plugin.views.outputs[i] != output || plugin.views.masks[i] != mask)
+         continue;
+
+      const wlc_handle view = plugin.views.handles[i];
+      check_parent(view);
+
+      const struct view_info info = {
+         .output = output,
+         .parent = plugin.views.parents[i],
+         .type = plugin.views.types[i],
+         .state = plugin.views.states[i],
+         .mask = mask,
+      };
+
+      if (info_is_tiled(&info) && !chck_iter_pool_push_back(&plugin.query, &view))
+         return NULL;
+   }
+
+   *out_memb = plugin.query.items.count;
+   return (void*)plugin.query.items.buffer;
+}
+
+static bool
+view_created(wlc_handle view)
+{
+   cache_view(view);
+   return true;
+}
+
+static void
+view_destroyed(wlc_handle view)
+{
+   uncache_view(view);
+}
+
+static void
+view_move_to_output(wlc_handle view, wlc_handle from, wlc_handle to)
+{
+   (void)from, (void)to;
+   refresh_view(view);
+}
+
+static void
+view_geometry_request(wlc_handle view, const struct wlc_geometry *geometry)
+{
+   (void)geometry;
+   check_parent(view);
+}
+
+static void
+plugin_deloaded(plugin_h ph)
+{
+   const struct raise_listener *l;
+   chck_iter_pool_for_each(&plugin.listeners, l) {
+      if (l->owner != ph)
+         continue;
+
+      chck_iter_pool_remove(&plugin.listeners, _I - 1);
+      --_I;
+   }
+}
+
+static void
+view_state_request(wlc_handle view, const enum wlc_view_state_bit state, const bool toggle)
+{
+   (void)state, (void)toggle;
+   refresh_view(view);
+}
+
+#pragma GCC diagnostic ignored "-Wmissing-prototypes"
+
+void
+plugin_deinit(plugin_h self)
+{
+   (void)self;
+   for (size_t i = 0; i < plugin.views.count; ++i)
+      chck_iter_pool_release(&plugin.views.children[i]);
+
+   free(plugin.views.handles);
+   free(plugin.views.outputs);
+   free(plugin.views.parents);
+   free(plugin.views.children);
+   free(plugin.views.types);
+   free(plugin.views.states);
+   free(plugin.views.masks);
+   chck_hash_table_release(&plugin.slots);
+   chck_iter_pool_release(&plugin.query);
+   chck_iter_pool_release(&plugin.family);
+   chck_iter_pool_release(&plugin.fullscreen);
+   chck_iter_pool_release(&plugin.listeners);
+   memset(&plugin.views, 0, sizeof(plugin.views));
+}
+
+bool
+plugin_init(plugin_h self)
+{
+   plugin.self = self;
+
+   plugin_h orbment;
+   if (!(orbment = import_plugin(self, "orbment")))
+      return false;
+
+   if (!(add_hook = import_method(self, orbment, "add_hook", "b(h,c[],fun,i32)|1")))
+      return false;
+
+   if (!chck_hash_table(&plugin.slots, 0, 256, sizeof(size_t)) ||
+       !chck_iter_pool(&plugin.query, 32, 0, sizeof(wlc_handle)) ||
+       !chck_iter_pool(&plugin.family, 8, 0, sizeof(wlc_handle)) ||
+       !chck_iter_pool(&plugin.fullscreen, 4, 0, sizeof(wlc_handle)) ||
+       !chck_iter_pool(&plugin.listeners, 2, 0, sizeof(struct raise_listener)))
+      return false;
+
+   size_t outputs;
+   const wlc_handle *o = wlc_get_outputs(&outputs);
+   for (size_t i = 0; i < outputs; ++i) {
+      size_t memb;
+      const wlc_handle *views = wlc_output_get_views(o[i], &memb);
+      for (size_t v = 0; v < memb; ++v)
+         cache_view(views[v]);
+   }
+
+   // Cache before anyone else sees the view and forget it after everyone else is done with it.
+   // state_request runs last to pick up what other hooks did to the view.
+   // wlc has no hook for reparenting, geometry requests usually follow one, so parent is checked there as well.
+   return (add_hook(self, "view.created", FUN(view_created, "b(h)|1"), HOOK_PRIORITY_MONITOR) &&
+           add_hook(self, "view.destroyed", FUN(view_destroyed, "v(h)|1"), HOOK_PRIORITY_LOW - 1) &&
+           add_hook(self, "view.move_to_output", FUN(view_move_to_output, "v(h,h,h)|1"), HOOK_PRIORITY_MONITOR) &&
+           add_hook(self, "view.geometry_request", FUN(view_geometry_request, "v(h,*)|1"), HOOK_PRIORITY_MONITOR) &&
+           add_hook(self, "view.state_request", FUN(view_state_request, "v(h,e,b)|1"), HOOK_PRIORITY_LOW - 1) &&
+           add_hook(self, "plugin.deloaded", FUN(plugin_deloaded, "v(h)|1"), HOOK_PRIORITY_DEFAULT));
+}
+
+PLUGIN_INFO_VERSION_EXPORT;
+
+PCONST const struct plugin_info*
+plugin_register(void)
+{
+   static const struct method methods[] = {
+      REGISTER_METHOD(get_view, "b(h,*)|1"),
+      REGISTER_METHOD(get_tiled_views, "*(h,u32,*)|1"),
+      REGISTER_METHOD(set_state, "v(h,e,b)|1"),
+      REGISTER_METHOD(set_type, "v(h,u32,b)|1"),
+      REGISTER_METHOD(set_mask, "v(h,u32)|1"),
+      REGISTER_METHOD(set_output, "v(h,h)|1"),
+      REGISTER_METHOD(set_parent, "v(h,h)|1"),
+      REGISTER_METHOD(get_children, "*(h,*)|1"),
+      REGISTER_METHOD(get_root, "h(h)|1"),
+      REGISTER_METHOD(bring_to_front, "v(h)|1"),
+      REGISTER_METHOD(add_raise_listener, "b(h,fun)|1"),
+      REGISTER_METHOD(get_fullscreen, "h(h)|1"),
+      REGISTER_METHOD(refresh_view, "v(h)|1"),
+      {0},
+   };
+
+   static const struct plugin_info info = {
+      .name = "view-cache",
+      .description = "Cached view properties.",
+      .version = VERSION,
+      .methods = methods,
+   };
+
+   return &info;
+}
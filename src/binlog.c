@@ -0,0 +1,290 @@
+#include "binlog.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+struct writer {
+   uint8_t *buf;
+   size_t size, off;
+};
+
+static void
+put(struct writer *w, const void *data, size_t len)
+{
+   assert(w && data);
+
+   if (w->off < w->size)
+      memcpy(w->buf + w->off, data, (len < w->size - w->off ? len : w->size - w->off));
+
+   w->off += len;
+}
+
+static void
+put_u8(struct writer *w, uint8_t v)
+{
+   put(w, &v, sizeof(v));
+}
+
+static void
+put_u32(struct writer *w, uint32_t v)
+{
+   put(w, &v, sizeof(v));
+}
+
+static void
+put_u64(struct writer *w, uint64_t v)
+{
+   put(w, &v, sizeof(v));
+}
+
+static void
+begin_record(struct writer *w, enum binlog_record type)
+{
+   assert(w);
+   put_u32(w, 0);
+   put_u8(w, type);
+}
+
+static size_t
+end_record(struct writer *w)
+{
+   assert(w);
+   const uint32_t size = w->off;
+   if (w->size >= sizeof(size))
+      memcpy(w->buf, &size, sizeof(size));
+   return w->off;
+}
+
+const char*
+binlog_next_spec(const char *fmt, const char **out_start, struct binlog_spec *out_spec)
+{
+   assert(fmt && out_start && out_spec);
+
+   for (; *fmt; ++fmt) {
+      if (*fmt != '%')
+         continue;
+
+      struct binlog_spec *s = out_spec;
+      memset(s, 0, sizeof(struct binlog_spec));
+      *out_start = fmt++;
+
+      if (*fmt == '%') {
+         s->conversion = '%';
+         return fmt + 1;
+      }
+
+      s->flags.data = fmt;
+      while (*fmt && strchr("-+ #0'", *fmt))
+         ++fmt;
+      s->flags.len = fmt - s->flags.data;
+
+      s->width.data = fmt;
+      if (*fmt == '*') {
+         s->width_arg = true;
+         ++fmt;
+      } else {
+         while (*fmt >= '0' && *fmt <= '9')
+            ++fmt;
+      }
+      s->width.len = fmt - s->width.data;
+
+      if (*fmt == '.') {
+         s->has_precision = true;
+         s->precision.data = ++fmt;
+         if (*fmt == '*') {
+            s->precision_arg = true;
+            ++fmt;
+         } else {
+            while (*fmt >= '0' && *fmt <= '9')
+               ++fmt;
+         }
+         s->precision.len = fmt - s->precision.data;
+      }
+
+      switch (*fmt) {
+         case 'h':
+            s->length = (fmt[1] == 'h' ? BINLOG_LENGTH_HH : BINLOG_LENGTH_H);
+            fmt += (s->length == BINLOG_LENGTH_HH ? 2 : 1);
+            break;
+         case 'l':
+            s->length = (fmt[1] == 'l' ? BINLOG_LENGTH_LL : BINLOG_LENGTH_L);
+            fmt += (s->length == BINLOG_LENGTH_LL ? 2 : 1);
+            break;
+         case 'j': s->length = BINLOG_LENGTH_J; ++fmt; break;
+         case 'z': s->length = BINLOG_LENGTH_Z; ++fmt; break;
+         case 't': s->length = BINLOG_LENGTH_T; ++fmt; break;
+         case 'L': s->length = BINLOG_LENGTH_LONG_DOUBLE; ++fmt; break;
+         default: break;
+      }
+
+      switch ((s->conversion = *fmt)) {
+         case 'd': case 'i': case 'c':
+            s->arg = BINLOG_ARG_INT;
+            break;
+         case 'u': case 'o': case 'x': case 'X':
+            s->arg = BINLOG_ARG_UINT;
+            break;
+         case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            s->arg = BINLOG_ARG_DOUBLE;
+            break;
+         case 's':
+            s->arg = BINLOG_ARG_STRING;
+            break;
+         case 'p':
+            s->arg = BINLOG_ARG_POINTER;
+            break;
+         case 'n':
+            s->arg = BINLOG_ARG_COUNT;
+            break;
+         case '\0':
+            return NULL;
+         default:
+            s->arg = BINLOG_ARG_NONE;
+            break;
+      }
+
+      return fmt + 1;
+   }
+
+   return NULL;
+}
+
+static int64_t
+read_int(const struct binlog_spec *spec, va_list *ap)
+{
+   assert(spec && ap);
+
+   switch (spec->length) {
+      case BINLOG_LENGTH_L: return va_arg(*ap, long);
+      case BINLOG_LENGTH_LL: return va_arg(*ap, long long);
+      case BINLOG_LENGTH_J: return va_arg(*ap, intmax_t);
+      case BINLOG_LENGTH_Z: return va_arg(*ap, ptrdiff_t);
+      case BINLOG_LENGTH_T: return va_arg(*ap, ptrdiff_t);
+      case BINLOG_LENGTH_HH: return (signed char)va_arg(*ap, int);
+      case BINLOG_LENGTH_H: return (short)va_arg(*ap, int);
+      default: break;
+   }
+
+   return va_arg(*ap, int);
+}
+
+static uint64_t
+read_uint(const struct binlog_spec *spec, va_list *ap)
+{
+   assert(spec && ap);
+
+   switch (spec->length) {
+      case BINLOG_LENGTH_L: return va_arg(*ap, unsigned long);
+      case BINLOG_LENGTH_LL: return va_arg(*ap, unsigned long long);
+      case BINLOG_LENGTH_J: return va_arg(*ap, uintmax_t);
+      case BINLOG_LENGTH_Z: return va_arg(*ap, size_t);
+      case BINLOG_LENGTH_T: return va_arg(*ap, size_t);
+      case BINLOG_LENGTH_HH: return (unsigned char)va_arg(*ap, unsigned int);
+      case BINLOG_LENGTH_H: return (unsigned short)va_arg(*ap, unsigned int);
+      default: break;
+   }
+
+   return va_arg(*ap, unsigned int);
+}
+
+size_t
+binlog_encode_session(uint8_t *buf, size_t size)
+{
+   struct writer w = { buf, size, 0 };
+   begin_record(&w, BINLOG_RECORD_SESSION);
+   put_u32(&w, BINLOG_MAGIC);
+   put_u32(&w, BINLOG_VERSION);
+   return end_record(&w);
+}
+
+size_t
+binlog_encode_string(uint8_t *buf, size_t size, const char *str, uint16_t generation)
+{
+   struct writer w = { buf, size, 0 };
+   begin_record(&w, BINLOG_RECORD_STRING);
+   put_u64(&w, binlog_string_id(str, generation));
+   put(&w, str, strlen(str));
+   return end_record(&w);
+}
+
+size_t
+binlog_encode_dropped(uint8_t *buf, size_t size, uint64_t count)
+{
+   struct writer w = { buf, size, 0 };
+   begin_record(&w, BINLOG_RECORD_DROPPED);
+   put_u64(&w, count);
+   return end_record(&w);
+}
+
+size_t
+binlog_encode_message(uint8_t *buf, size_t size, int64_t sec, uint32_t usec, uint8_t type, const char *fmt, const char *prefix, uint16_t generation, va_list ap)
+{
+   struct writer w = { buf, size, 0 };
+   begin_record(&w, BINLOG_RECORD_MESSAGE);
+   put_u64(&w, sec);
+   put_u32(&w, usec);
+   put_u8(&w, type);
+   put_u64(&w, binlog_string_id(fmt, generation));
+   put_u64(&w, binlog_string_id(prefix, generation));
+
+   va_list copy;
+   va_copy(copy, ap);
+
+   const char *start;
+   struct binlog_spec spec;
+   while ((fmt = binlog_next_spec(fmt, &start, &spec))) {
+      if (spec.width_arg)
+         put_u64(&w, va_arg(copy, int));
+
+      // string may not be terminated if precision is given
+      size_t limit = BINLOG_STRING_ARG_MAX;
+      if (spec.precision_arg) {
+         const int precision = va_arg(copy, int);
+         limit = (precision >= 0 && (size_t)precision < limit ? (size_t)precision : limit);
+         put_u64(&w, precision);
+      } else if (spec.has_precision) {
+         const size_t precision = strtoul(spec.precision.data, NULL, 10);
+         limit = (precision < limit ? precision : limit);
+      }
+
+      switch (spec.arg) {
+         case BINLOG_ARG_INT:
+            put_u64(&w, read_int(&spec, &copy));
+            break;
+
+         case BINLOG_ARG_UINT:
+            put_u64(&w, read_uint(&spec, &copy));
+            break;
+
+         case BINLOG_ARG_DOUBLE: {
+            const double d = (spec.length == BINLOG_LENGTH_LONG_DOUBLE ? (double)va_arg(copy, long double) : va_arg(copy, double));
+            put(&w, &d, sizeof(d));
+         }
+         break;
+
+         case BINLOG_ARG_STRING: {
+            const char *str = va_arg(copy, const char*);
+            str = (str ? str : "(null)");
+            const size_t len = strnlen(str, limit);
+            put_u32(&w, len);
+            put(&w, str, len);
+         }
+         break;
+
+         case BINLOG_ARG_POINTER:
+            put_u64(&w, (uintptr_t)va_arg(copy, void*));
+            break;
+
+         case BINLOG_ARG_COUNT:
+            va_arg(copy, void*);
+            break;
+
+         case BINLOG_ARG_NONE:
+            break;
+      }
+   }
+
+   va_end(copy);
+   return end_record(&w);
+}
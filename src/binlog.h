@@ -0,0 +1,108 @@
+#ifndef __orbment_binlog_h__
+#define __orbment_binlog_h__
+
+#include <orbment/defines.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+/**
+ * Binary log format, written with --log-binary and decoded by orbment-logdump.
+ *
+ * Messages are not formatted at runtime. Instead the id of the format string,
+ * timestamp, prefix id and raw arguments are stored. Format strings and prefixes
+ * are stored once per generation as string records, see binlog_string_id.
+ *
+ * The log is a stream of records, each starting with u32 size (including the header) and u8 type.
+ * All integers are in host byte order, the log is meant to be decoded on the same machine.
+ *
+ * SESSION: u32 magic, u32 version
+ * STRING:  u64 id, bytes of the string (not zero-terminated)
+ * MESSAGE: i64 seconds, u32 microseconds, u8 log type, u64 format id, u64 prefix id (0 for none), arguments
+ * DROPPED: u64 count of messages dropped
+ *
+ * Arguments are stored in the order of the conversions in the format string:
+ * integers, characters, pointers and * widths or precisions as 8 bytes, floating points as double,
+ * strings as u32 length and the bytes.
+ */
+
+enum {
+   BINLOG_MAGIC = 0x474c424f, // "OBLG"
+   BINLOG_VERSION = 1,
+   BINLOG_RECORD_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint8_t),
+   BINLOG_STRING_ARG_MAX = 4096, // longer string arguments are truncated
+};
+
+enum binlog_record {
+   BINLOG_RECORD_SESSION,
+   BINLOG_RECORD_STRING,
+   BINLOG_RECORD_MESSAGE,
+   BINLOG_RECORD_DROPPED,
+};
+
+enum binlog_arg {
+   BINLOG_ARG_NONE,
+   BINLOG_ARG_INT,
+   BINLOG_ARG_UINT,
+   BINLOG_ARG_DOUBLE,
+   BINLOG_ARG_STRING,
+   BINLOG_ARG_POINTER,
+   BINLOG_ARG_COUNT, // %n, nothing is stored
+};
+
+enum binlog_length {
+   BINLOG_LENGTH_NONE,
+   BINLOG_LENGTH_HH,
+   BINLOG_LENGTH_H,
+   BINLOG_LENGTH_L,
+   BINLOG_LENGTH_LL,
+   BINLOG_LENGTH_J,
+   BINLOG_LENGTH_Z,
+   BINLOG_LENGTH_T,
+   BINLOG_LENGTH_LONG_DOUBLE,
+};
+
+/**
+ * Parsed printf conversion specification.
+ * flags, width and precision point to the format string.
+ */
+struct binlog_spec {
+   struct {
+      const char *data;
+      size_t len;
+   } flags, width, precision;
+
+   enum binlog_length length;
+   enum binlog_arg arg;
+   char conversion;
+   bool width_arg, precision_arg, has_precision;
+};
+
+/**
+ * Id of a string, its address with the generation in the top 16 bits, 0 for NULL.
+ * Generation changes when strings may have been freed, so a reused address gets a new id.
+ */
+static inline PCONST uint64_t
+binlog_string_id(const void *str, uint16_t generation)
+{
+   return (str ? (((uint64_t)(uintptr_t)str & 0xFFFFFFFFFFFFull) | ((uint64_t)generation << 48)) : 0);
+}
+
+/**
+ * Finds next conversion specification from fmt.
+ * Returns pointer past the specification, or NULL if there are no more.
+ * out_start is set to the '%' character of the specification.
+ */
+PNONULL const char* binlog_next_spec(const char *fmt, const char **out_start, struct binlog_spec *out_spec);
+
+/**
+ * Encodes records to buf.
+ * Returns the size of the record, nothing past size is written (like snprintf).
+ */
+PNONULL size_t binlog_encode_session(uint8_t *buf, size_t size);
+PNONULL size_t binlog_encode_string(uint8_t *buf, size_t size, const char *str, uint16_t generation);
+PNONULLV(1) size_t binlog_encode_dropped(uint8_t *buf, size_t size, uint64_t count);
+PNONULLV(1, 6) size_t binlog_encode_message(uint8_t *buf, size_t size, int64_t sec, uint32_t usec, uint8_t type, const char *fmt, const char *prefix, uint16_t generation, va_list ap);
+
+#endif /* __orbment_binlog_h__ */
@@ -0,0 +1,72 @@
+#include "histogram.h"
+#include <assert.h>
+
+PCONST static uint32_t
+msb64(uint64_t value)
+{
+   uint32_t msb = 0;
+   while (value >>= 1)
+      ++msb;
+   return msb;
+}
+
+PCONST static uint32_t
+index_for_value(uint64_t value)
+{
+   if (value < HISTOGRAM_SUB_BUCKETS)
+      return value;
+
+   if (value >> HISTOGRAM_MAX_BITS)
+      value = ((uint64_t)1 << HISTOGRAM_MAX_BITS) - 1;
+
+   const uint32_t exponent = msb64(value) - HISTOGRAM_SUB_BUCKET_BITS + 1;
+   return exponent * (HISTOGRAM_SUB_BUCKETS / 2) + (value >> exponent);
+}
+
+PCONST static uint64_t
+value_for_index(uint32_t index)
+{
+   if (index < HISTOGRAM_SUB_BUCKETS)
+      return index;
+
+   // middle of the bucket range
+   const uint32_t exponent = index / (HISTOGRAM_SUB_BUCKETS / 2) - 1;
+   const uint64_t sub = index - exponent * (HISTOGRAM_SUB_BUCKETS / 2);
+   return (sub << exponent) + (((uint64_t)1 << exponent) >> 1);
+}
+
+void
+histogram_record(struct histogram *histogram, uint64_t value)
+{
+   assert(histogram);
+   const uint32_t index = index_for_value(value);
+   assert(index < HISTOGRAM_BUCKETS);
+   histogram->counts[index]++;
+   histogram->count++;
+   histogram->sum += value;
+
+   if (value > histogram->max)
+      histogram->max = value;
+}
+
+uint64_t
+histogram_percentile(const struct histogram *histogram, double percentile)
+{
+   assert(histogram && percentile >= 0.0 && percentile <= 100.0);
+
+   if (!histogram->count)
+      return 0;
+
+   if (percentile >= 100.0)
+      return histogram->max;
+
+   const uint64_t target = (uint64_t)(histogram->count * percentile / 100.0 + 0.5);
+
+   uint64_t seen = 0;
+   for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+      if ((seen += histogram->counts[i]) >= target && seen > 0)
+         return (value_for_index(i) < histogram->max ? value_for_index(i) : histogram->max);
+   }
+
+   return histogram->max;
+}
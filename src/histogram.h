@@ -0,0 +1,27 @@
+#ifndef __orbment_histogram_h__
+#define __orbment_histogram_h__
+
+#include <orbment/defines.h>
+#include <stdint.h>
+
+enum {
+   HISTOGRAM_SUB_BUCKET_BITS = 5,
+   HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS,
+   HISTOGRAM_MAX_BITS = 36, // values are clamped to 2^36 - 1
+   HISTOGRAM_BUCKETS = (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * (HISTOGRAM_SUB_BUCKETS / 2) + HISTOGRAM_SUB_BUCKETS / 2,
+};
+
+/**
+ * HDR style histogram.
+ * Each power of two range is split linearly into sub buckets,
+ * so relative error of the recorded values stays under 1 / (HISTOGRAM_SUB_BUCKETS / 2).
+ */
+struct histogram {
+   uint64_t counts[HISTOGRAM_BUCKETS];
+   uint64_t count, sum, max;
+};
+
+PNONULL void histogram_record(struct histogram *histogram, uint64_t value);
+PNONULL PPURE uint64_t histogram_percentile(const struct histogram *histogram, double percentile);
+
+#endif /* __orbment_histogram_h__ */
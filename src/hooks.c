@@ -1,6 +1,16 @@
 #include "hooks.h"
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <wlc/wlc.h>
 #include <chck/pool/pool.h>
+#include "histogram.h"
+#include "recorder.h"
+#include "launcher.h"
 #include "plugin.h"
 #include "config.h"
 
@@ -36,55 +46,212 @@ enum hook_type {
 
 struct hook {
    void *function;
+   struct histogram *latency; // NULL, unless profiling is enabled
    plugin_h owner;
+   int32_t priority;
 };
 
 static struct chck_iter_pool hooks[HOOK_LAST];
 
+// plugins with parallel_init add hooks from multiple threads, hooks are only dispatched from the main thread
+static pthread_mutex_t hooks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+   // SIGUSR1 writes to the pipe, dump happens from the event loop
+   struct wlc_event_source *source;
+   int pipe[2];
+   bool enabled;
+} profiling = { .pipe = { -1, -1 } };
+
+// In same order as enum hook_type
+static const struct {
+   const char *name;
+   enum hook_type type;
+} hook_map[] = {
+   { "plugin.loaded", HOOK_PLUGIN_LOADED },
+   { "plugin.deloaded", HOOK_PLUGIN_DELOADED },
+   { "output.created", HOOK_OUTPUT_CREATED },
+   { "output.destroyed", HOOK_OUTPUT_DESTROYED },
+   { "output.focus", HOOK_OUTPUT_FOCUS },
+   { "output.resolution", HOOK_OUTPUT_RESOLUTION },
+   { "view.created", HOOK_VIEW_CREATED },
+   { "view.destroyed", HOOK_VIEW_DESTROYED },
+   { "view.focus", HOOK_VIEW_FOCUS },
+   { "view.move_to_output", HOOK_VIEW_MOVE_TO_OUTPUT },
+   { "view.geometry_request", HOOK_VIEW_GEOMETRY_REQUEST },
+   { "view.state_request", HOOK_VIEW_STATE_REQUEST },
+   { "view.move_request", HOOK_VIEW_MOVE_REQUEST },
+   { "view.resize_request", HOOK_VIEW_RESIZE_REQUEST },
+   { "keyboard.key", HOOK_KEYBOARD_KEY },
+   { "pointer.button", HOOK_POINTER_BUTTON },
+   { "pointer.scroll", HOOK_POINTER_SCROLL },
+   { "pointer.motion", HOOK_POINTER_MOTION },
+   { "touch", HOOK_TOUCH },
+   { "compositor.ready", HOOK_COMPOSITOR_READY },
+   { "input.created", HOOK_INPUT_CREATED },
+   { "input.destroyed", HOOK_INPUT_DESTROYED },
+   { "output.pre_render", HOOK_OUTPUT_PRE_RENDER },
+   { "output.post_render", HOOK_OUTPUT_POST_RENDER },
+   { "view.pre_render", HOOK_VIEW_PRE_RENDER },
+   { "view.post_render", HOOK_VIEW_POST_RENDER },
+   { NULL, HOOK_LAST },
+};
+
+const char*
+hooks_name_for_type(uint8_t type)
+{
+   return (type < HOOK_LAST ? hook_map[type].name : NULL);
+}
+
 static enum hook_type
 hook_type_for_string(const char *type)
 {
-   struct {
-      const char *name;
-      enum hook_type type;
-   } map[] = {
-      { "plugin.loaded", HOOK_PLUGIN_LOADED },
-      { "plugin.deloaded", HOOK_PLUGIN_DELOADED },
-      { "output.created", HOOK_OUTPUT_CREATED },
-      { "output.destroyed", HOOK_OUTPUT_DESTROYED },
-      { "output.focus", HOOK_OUTPUT_FOCUS },
-      { "output.resolution", HOOK_OUTPUT_RESOLUTION },
-      { "view.created", HOOK_VIEW_CREATED },
-      { "view.destroyed", HOOK_VIEW_DESTROYED },
-      { "view.focus", HOOK_VIEW_FOCUS },
-      { "view.move_to_output", HOOK_VIEW_MOVE_TO_OUTPUT },
-      { "view.geometry_request", HOOK_VIEW_GEOMETRY_REQUEST },
-      { "view.state_request", HOOK_VIEW_STATE_REQUEST },
-      { "view.move_request", HOOK_VIEW_MOVE_REQUEST },
-      { "view.resize_request", HOOK_VIEW_RESIZE_REQUEST },
-      { "keyboard.key", HOOK_KEYBOARD_KEY },
-      { "pointer.button", HOOK_POINTER_BUTTON },
-      { "pointer.scroll", HOOK_POINTER_SCROLL },
-      { "pointer.motion", HOOK_POINTER_MOTION },
-      { "touch", HOOK_TOUCH },
-      { "compositor.ready", HOOK_COMPOSITOR_READY },
-      { "input.created", HOOK_INPUT_CREATED },
-      { "input.destroyed", HOOK_INPUT_DESTROYED },
-      { "output.pre_render", HOOK_OUTPUT_PRE_RENDER },
-      { "output.post_render", HOOK_OUTPUT_POST_RENDER },
-      { "view.pre_render", HOOK_VIEW_PRE_RENDER },
-      { "view.post_render", HOOK_VIEW_POST_RENDER },
-      { NULL, HOOK_LAST },
-   };
-
-   for (uint32_t i = 0; map[i].name; ++i) {
-      if (chck_cstreq(type, map[i].name))
-         return map[i].type;
+   for (uint32_t i = 0; hook_map[i].name; ++i) {
+      if (chck_cstreq(type, hook_map[i].name))
+         return hook_map[i].type;
    }
 
    return HOOK_LAST;
 }
 
+static inline uint64_t
+profile_now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+dump_hook_profile(void)
+{
+   if (!profiling.enabled) {
+      plog(0, PLOG_WARN, "Hook profiling is not enabled, run with --profile-hooks");
+      return;
+   }
+
+   plog(0, PLOG_INFO, "Hook latencies (calls, mean, p50, p90, p99, p99.9, max in microseconds):");
+
+   for (uint32_t t = 0; t < HOOK_LAST; ++t) {
+      const struct hook *h;
+      chck_iter_pool_for_each(&hooks[t], h) {
+         const struct histogram *l;
+         if (!(l = h->latency) || !l->count)
+            continue;
+
+         plog(h->owner, PLOG_INFO, "%s: %" PRIu64 " calls, %.1f, %.1f, %.1f, %.1f, %.1f, %.1f", hook_map[t].name, l->count,
+               l->sum / (double)l->count / 1e3, histogram_percentile(l, 50.0) / 1e3, histogram_percentile(l, 90.0) / 1e3,
+               histogram_percentile(l, 99.0) / 1e3, histogram_percentile(l, 99.9) / 1e3, l->max / 1e3);
+      }
+   }
+
+   launcher_dump_latency();
+}
+
+/**
+ * Records the hook call to the flight recorder.
+ * Returns sequence number for dispatch_end.
+ */
+static inline uint64_t
+dispatch_begin(const struct hook *hook, enum hook_type type, uintptr_t handle)
+{
+   assert(hook);
+   return recorder_begin(type, hook->owner, handle, profile_now());
+}
+
+static inline void
+dispatch_end(struct hook *hook, uint64_t seq)
+{
+   assert(hook);
+
+   if (!profiling.enabled) {
+      recorder_end(seq, 0);
+      return;
+   }
+
+   uint64_t duration;
+   if ((duration = recorder_end(seq, profile_now())) && (hook->latency || (hook->latency = calloc(1, sizeof(struct histogram)))))
+      histogram_record(hook->latency, duration);
+}
+
+void
+hooks_set_profiling(bool enabled)
+{
+   profiling.enabled = enabled;
+}
+
+void
+hooks_request_profile_dump(void)
+{
+   if (profiling.pipe[1] < 0)
+      return;
+
+   const int saved = errno;
+   while (write(profiling.pipe[1], "", 1) < 0 && errno == EINTR);
+   errno = saved;
+}
+
+static int
+profile_dump_readable(int fd, uint32_t mask, void *arg)
+{
+   (void)mask, (void)arg;
+
+   char buf[32];
+   while (read(fd, buf, sizeof(buf)) > 0);
+
+   dump_hook_profile();
+   return 0;
+}
+
+static bool
+profile_dump_listen(void)
+{
+   if (pipe(profiling.pipe) != 0)
+      goto error0;
+
+   for (uint32_t i = 0; i < 2; ++i) {
+      if (fcntl(profiling.pipe[i], F_SETFD, FD_CLOEXEC) != 0 || fcntl(profiling.pipe[i], F_SETFL, O_NONBLOCK) != 0)
+         goto error1;
+   }
+
+   if (!(profiling.source = wlc_event_loop_add_fd(profiling.pipe[0], WLC_EVENT_READABLE, profile_dump_readable, NULL)))
+      goto error1;
+
+   return true;
+
+error1:
+   close(profiling.pipe[0]);
+   close(profiling.pipe[1]);
+   profiling.pipe[0] = profiling.pipe[1] = -1;
+error0:
+   plog(0, PLOG_WARN, "Could not listen for profile dump requests");
+   return false;
+}
+
+static void
+profile_dump_release(void)
+{
+   if (profiling.source)
+      wlc_event_source_remove(profiling.source);
+
+   // write end first, the signal handler checks it
+   for (int32_t i = 1; i >= 0; --i) {
+      if (profiling.pipe[i] >= 0)
+         close(profiling.pipe[i]);
+      profiling.pipe[i] = -1;
+   }
+
+   profiling.source = NULL;
+}
+
+static void
+hook_release(struct hook *hook)
+{
+   assert(hook);
+   free(hook->latency);
+   hook->latency = NULL;
+}
+
 static bool
 hook_exists_for_plugin(plugin_h caller, enum hook_type t)
 {
@@ -97,7 +264,7 @@ hook_exists_for_plugin(plugin_h caller, enum hook_type t)
 }
 
 static bool
-add_hook(plugin_h caller, const char *type, const struct function *hook)
+add_hook_unlocked(plugin_h caller, const char *type, const struct function *hook, int32_t priority)
 {
    if (!hook || !caller)
       return false;
@@ -153,13 +320,40 @@ add_hook(plugin_h caller, const char *type, const struct function *hook)
    struct hook h = {
       .function = hook->function,
       .owner = caller,
+      .priority = priority,
    };
 
-   return chck_iter_pool_push_back(&hooks[t], &h);
+   // Keep the dispatch array sorted by priority, hooks with same priority are called in order they were added.
+   size_t index = hooks[t].items.count;
+   struct hook *o;
+   chck_iter_pool_for_each(&hooks[t], o) {
+      if (o->priority >= priority)
+         continue;
+
+      index = _I - 1;
+      break;
+   }
+
+   return chck_iter_pool_insert(&hooks[t], index, &h);
+}
+
+static bool
+add_hook_with_priority(plugin_h caller, const char *type, const struct function *hook, int32_t priority)
+{
+   pthread_mutex_lock(&hooks_mutex);
+   const bool ret = add_hook_unlocked(caller, type, hook, priority);
+   pthread_mutex_unlock(&hooks_mutex);
+   return ret;
+}
+
+static bool
+add_hook(plugin_h caller, const char *type, const struct function *hook)
+{
+   return add_hook_with_priority(caller, type, hook, HOOK_PRIORITY_DEFAULT);
 }
 
 static void
-remove_hook(plugin_h caller, const char *type)
+remove_hook_unlocked(plugin_h caller, const char *type)
 {
    if (!type || !caller)
       return;
@@ -175,11 +369,20 @@ remove_hook(plugin_h caller, const char *type)
       if (h->owner != caller)
          continue;
 
+      hook_release(h);
       chck_iter_pool_remove(&hooks[t], _I - 1);
       break;
    }
 }
 
+static void
+remove_hook(plugin_h caller, const char *type)
+{
+   pthread_mutex_lock(&hooks_mutex);
+   remove_hook_unlocked(caller, type);
+   pthread_mutex_unlock(&hooks_mutex);
+}
+
 static void
 remove_hooks_for_plugin(plugin_h caller)
 {
@@ -189,6 +392,7 @@ remove_hooks_for_plugin(plugin_h caller)
          if (h->owner != caller)
             continue;
 
+         hook_release(h);
          chck_iter_pool_remove(&hooks[i], _I - 1);
          break;
       }
@@ -198,8 +402,12 @@ remove_hooks_for_plugin(plugin_h caller)
 static void
 hooks_remove_all(void)
 {
-   for (uint32_t i = 0; i < HOOK_LAST; ++i)
+   profile_dump_release();
+
+   for (uint32_t i = 0; i < HOOK_LAST; ++i) {
+      chck_iter_pool_for_each_call(&hooks[i], hook_release);
       chck_iter_pool_release(&hooks[i]);
+   }
 }
 
 static void
@@ -210,7 +418,9 @@ plugin_loaded(const struct plugin *plugin)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_PLUGIN_LOADED], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_PLUGIN_LOADED, plugin->handle + 1);
       fun(plugin->handle + 1);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -222,7 +432,9 @@ plugin_deloaded(const struct plugin *plugin)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_PLUGIN_DELOADED], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_PLUGIN_DELOADED, plugin->handle + 1);
       fun(plugin->handle + 1);
+      dispatch_end(hook, seq);
    }
 
    remove_hooks_for_plugin(plugin->handle + 1);
@@ -235,7 +447,11 @@ output_created(wlc_handle output)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_OUTPUT_CREATED], hook) {
       bool (*fun)() = hook->function;
-      if (!fun(output))
+      const uint64_t seq = dispatch_begin(hook, HOOK_OUTPUT_CREATED, output);
+      const bool ok = fun(output);
+      dispatch_end(hook, seq);
+
+      if (!ok)
          created = false;
    }
 
@@ -251,7 +467,9 @@ output_destroyed(wlc_handle output)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_OUTPUT_DESTROYED], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_OUTPUT_DESTROYED, output);
       fun(output);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -261,7 +479,9 @@ output_focus(wlc_handle output, bool focus)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_OUTPUT_FOCUS], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_OUTPUT_FOCUS, output);
       fun(output, focus);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -271,7 +491,9 @@ output_resolution(wlc_handle output, const struct wlc_size *from, const struct w
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_OUTPUT_RESOLUTION], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_OUTPUT_RESOLUTION, output);
       fun(output, from, to);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -281,7 +503,9 @@ output_pre_render(wlc_handle output)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_OUTPUT_PRE_RENDER], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_OUTPUT_PRE_RENDER, output);
       fun(output);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -291,7 +515,9 @@ output_post_render(wlc_handle output)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_OUTPUT_POST_RENDER], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_OUTPUT_POST_RENDER, output);
       fun(output);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -302,7 +528,11 @@ view_created(wlc_handle view)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_CREATED], hook) {
       bool (*fun)() = hook->function;
-      if (!fun(view))
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_CREATED, view);
+      const bool ok = fun(view);
+      dispatch_end(hook, seq);
+
+      if (!ok)
          created = false;
    }
 
@@ -318,7 +548,9 @@ view_destroyed(wlc_handle view)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_DESTROYED], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_DESTROYED, view);
       fun(view);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -328,7 +560,9 @@ view_focus(wlc_handle view, bool focus)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_FOCUS], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_FOCUS, view);
       fun(view, focus);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -338,7 +572,9 @@ view_move_to_output(wlc_handle view, wlc_handle from, wlc_handle to)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_MOVE_TO_OUTPUT], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_MOVE_TO_OUTPUT, view);
       fun(view, from, to);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -348,7 +584,9 @@ view_geometry_request(wlc_handle view, const struct wlc_geometry *geometry)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_GEOMETRY_REQUEST], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_GEOMETRY_REQUEST, view);
       fun(view, geometry);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -358,7 +596,9 @@ view_state_request(wlc_handle view, const enum wlc_view_state_bit state, const b
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_STATE_REQUEST], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_STATE_REQUEST, view);
       fun(view, state, toggle);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -368,7 +608,9 @@ view_move_request(wlc_handle view, const struct wlc_point *point)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_MOVE_REQUEST], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_MOVE_REQUEST, view);
       fun(view, point);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -378,7 +620,9 @@ view_resize_request(wlc_handle view, uint32_t edges, const struct wlc_point *poi
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_RESIZE_REQUEST], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_RESIZE_REQUEST, view);
       fun(view, edges, point);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -388,7 +632,9 @@ view_pre_render(wlc_handle view)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_PRE_RENDER], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_PRE_RENDER, view);
       fun(view);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -398,7 +644,9 @@ view_post_render(wlc_handle view)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_VIEW_POST_RENDER], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_VIEW_POST_RENDER, view);
       fun(view);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -406,65 +654,80 @@ static bool
 keyboard_key(wlc_handle view, uint32_t time, const struct wlc_modifiers *modifiers, uint32_t key, enum wlc_key_state state)
 {
    struct hook *hook;
-   bool handled = false;
    chck_iter_pool_for_each(&hooks[HOOK_KEYBOARD_KEY], hook) {
       bool (*fun)() = hook->function;
-      if (fun(view, time, modifiers, key, state))
-         handled = true;
+      const uint64_t seq = dispatch_begin(hook, HOOK_KEYBOARD_KEY, view);
+      const bool handled = fun(view, time, modifiers, key, state);
+      dispatch_end(hook, seq);
+
+      if (handled)
+         return true;
    }
-   return handled;
+   return false;
 }
 
 static bool
 pointer_button(wlc_handle view, uint32_t time, const struct wlc_modifiers *modifiers, uint32_t button, enum wlc_button_state state, const struct wlc_point *point)
 {
    struct hook *hook;
-   bool handled = false;
    chck_iter_pool_for_each(&hooks[HOOK_POINTER_BUTTON], hook) {
       bool (*fun)() = hook->function;
-      if (fun(view, time, modifiers, button, state, point))
-         handled = true;
+      const uint64_t seq = dispatch_begin(hook, HOOK_POINTER_BUTTON, view);
+      const bool handled = fun(view, time, modifiers, button, state, point);
+      dispatch_end(hook, seq);
+
+      if (handled)
+         return true;
    }
-   return handled;
+   return false;
 }
 
 static bool
 pointer_scroll(wlc_handle view, uint32_t time, const struct wlc_modifiers *modifiers, uint8_t axis_bits, double amount[2])
 {
    struct hook *hook;
-   bool handled = false;
    chck_iter_pool_for_each(&hooks[HOOK_POINTER_SCROLL], hook) {
       bool (*fun)() = hook->function;
-      if (fun(view, time, modifiers, axis_bits, amount))
-         handled = true;
+      const uint64_t seq = dispatch_begin(hook, HOOK_POINTER_SCROLL, view);
+      const bool handled = fun(view, time, modifiers, axis_bits, amount);
+      dispatch_end(hook, seq);
+
+      if (handled)
+         return true;
    }
-   return handled;
+   return false;
 }
 
 static bool
 pointer_motion(wlc_handle view, uint32_t time, const struct wlc_point *motion)
 {
    struct hook *hook;
-   bool handled = false;
    chck_iter_pool_for_each(&hooks[HOOK_POINTER_MOTION], hook) {
       bool (*fun)() = hook->function;
-      if (fun(view, time, motion))
-         handled = true;
+      const uint64_t seq = dispatch_begin(hook, HOOK_POINTER_MOTION, view);
+      const bool handled = fun(view, time, motion);
+      dispatch_end(hook, seq);
+
+      if (handled)
+         return true;
    }
-   return handled;
+   return false;
 }
 
 static bool
 touch(wlc_handle view, uint32_t time, const struct wlc_modifiers *modifiers, enum wlc_touch_type type, int32_t slot, const struct wlc_point *touch)
 {
    struct hook *hook;
-   bool handled = false;
    chck_iter_pool_for_each(&hooks[HOOK_TOUCH], hook) {
       bool (*fun)() = hook->function;
-      if (fun(view, time, modifiers, type, slot, touch))
-         handled = true;
+      const uint64_t seq = dispatch_begin(hook, HOOK_TOUCH, view);
+      const bool handled = fun(view, time, modifiers, type, slot, touch);
+      dispatch_end(hook, seq);
+
+      if (handled)
+         return true;
    }
-   return handled;
+   return false;
 }
 
 static void
@@ -475,7 +738,9 @@ compositor_ready(void)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_COMPOSITOR_READY], hook) {
       void (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_COMPOSITOR_READY, 0);
       fun();
+      dispatch_end(hook, seq);
    }
 }
 
@@ -493,7 +758,9 @@ input_created(struct libinput_device *device)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_INPUT_CREATED], hook) {
       bool (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_INPUT_CREATED, (uintptr_t)device);
       fun(device);
+      dispatch_end(hook, seq);
    }
    return true;
 }
@@ -504,7 +771,9 @@ input_destroyed(struct libinput_device *device)
    struct hook *hook;
    chck_iter_pool_for_each(&hooks[HOOK_INPUT_DESTROYED], hook) {
       bool (*fun)() = hook->function;
+      const uint64_t seq = dispatch_begin(hook, HOOK_INPUT_DESTROYED, (uintptr_t)device);
       fun(device);
+      dispatch_end(hook, seq);
    }
 }
 
@@ -538,11 +807,18 @@ hooks_setup(void)
    wlc_set_input_destroyed_cb(input_destroyed);
 
    plugin_set_callbacks(plugin_loaded, plugin_deloaded);
+   profile_dump_listen();
 
    {
       static const struct method methods[] = {
          REGISTER_METHOD(add_hook, "b(h,c[],fun)|1"),
+         REGISTER_METHOD_NAMED("add_hook", add_hook_with_priority, "b(h,c[],fun,i32)|1"),
          REGISTER_METHOD(remove_hook, "v(h,c[])|1"),
+         REGISTER_METHOD(dump_hook_profile, "v(v)|1"),
+         REGISTER_METHOD_NAMED("exec", launcher_spawn, "b(c[],c*[])|1"),
+         REGISTER_METHOD_NAMED("set_log_level", plugin_set_log_level, "b(c[],c[])|1"),
+         REGISTER_METHOD_NAMED("set_plugin_enabled", plugin_set_enabled, "b(c[],b)|1"),
+         REGISTER_METHOD_NAMED("list_group", plugin_list_group, "c*[](c[],sz*)|1"),
          {0},
       };
 
@@ -555,7 +831,7 @@ hooks_setup(void)
          },
       };
 
-      if (!plugin_register(&core, NULL))
+      if (!plugin_register(&core, NULL, PLUGIN_INFO_VERSION))
          return false;
    }
 
@@ -1,10 +1,19 @@
 #ifndef __orbment_hooks_h__
 #define __orbment_hooks_h__
 
+#include <orbment/defines.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 struct wlc_interface;
 
 bool hooks_setup(void);
+void hooks_set_profiling(bool enabled);
+
+/** async-signal-safe, the dump is written from the event loop. */
+void hooks_request_profile_dump(void);
+
+/** async-signal-safe, returns name of hook type, or NULL. */
+PCONST const char* hooks_name_for_type(uint8_t type);
 
 #endif /* __orbment_hooks_h__ */
@@ -0,0 +1,385 @@
+#include "launcher.h"
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <wlc/wlc.h>
+#include "histogram.h"
+#include "plugin.h"
+
+/**
+ * Forking the compositor copies page tables of its whole address space, GPU mappings included,
+ * which stalls the main loop for the duration. Instead a small launcher is forked at startup,
+ * and programs are run by it with posix_spawn. Requests carry argv and the current environment,
+ * as the environment of launcher is the one compositor was started with.
+ *
+ * Request: struct request, then file, argv and environment as NUL terminated strings.
+ * Reply: struct reply, for each request in order.
+ */
+
+enum {
+   // Bigger requests are executed with wlc_exec instead
+   SPAWN_MAX_REQUEST = 1024 * 1024,
+};
+
+struct request {
+   uint64_t stamp;
+   uint32_t size, argc, envc;
+};
+
+struct reply {
+   uint64_t stamp, duration;
+   int32_t pid, error;
+};
+
+extern char **environ;
+
+static struct {
+   struct histogram latency;
+   struct wlc_event_source *source;
+
+   // reply may arrive in pieces
+   struct {
+      uint8_t data[sizeof(struct reply)];
+      size_t size;
+   } partial;
+
+   pid_t pid;
+   int fd;
+} launcher = {
+   .fd = -1,
+};
+
+static inline uint64_t
+now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool
+read_full(int fd, void *data, size_t size)
+{
+   for (size_t off = 0; off < size;) {
+      const ssize_t r = read(fd, (uint8_t*)data + off, size - off);
+
+      if (r < 0 && errno == EINTR)
+         continue;
+
+      if (r <= 0)
+         return false;
+
+      off += r;
+   }
+
+   return true;
+}
+
+static bool
+write_full(int fd, const void *data, size_t size)
+{
+   for (size_t off = 0; off < size;) {
+      const ssize_t r = send(fd, (const uint8_t*)data + off, size - off, MSG_NOSIGNAL);
+
+      if (r < 0 && errno == EINTR)
+         continue;
+
+      if (r <= 0)
+         return false;
+
+      off += r;
+   }
+
+   return true;
+}
+
+/**
+ * Points strings to file, argv and environment in data, each array terminated with NULL.
+ * strings must have room for argc + envc + 3 pointers.
+ */
+static bool
+split_request(const struct request *req, char *data, char **strings)
+{
+   size_t n = 0;
+   char *p = data, *end = data + req->size;
+   for (uint32_t i = 0; i < 1 + req->argc + req->envc; ++i) {
+      if (i == 1 + req->argc)
+         strings[n++] = NULL;
+
+      if (p >= end)
+         return false;
+
+      strings[n++] = p;
+      p += strnlen(p, end - p) + 1;
+   }
+
+   if (req->envc == 0)
+      strings[n++] = NULL;
+
+   strings[n] = NULL;
+   return (p <= end);
+}
+
+static void
+launcher_handle(int fd, const posix_spawnattr_t *attr, const struct request *req, char *data)
+{
+   char **strings;
+   if (!(strings = calloc(req->argc + req->envc + 3, sizeof(char*))))
+      return;
+
+   struct reply reply = {
+      .stamp = req->stamp,
+      .pid = -1,
+      .error = EINVAL,
+   };
+
+   if (req->argc > 0 && split_request(req, data, strings)) {
+      char **argv = strings + 1, **envp = strings + req->argc + 2;
+
+      // PATH lookup of posix_spawnp uses environ
+      char **old = environ;
+      environ = envp;
+
+      pid_t pid;
+      const uint64_t start = now();
+      reply.error = posix_spawnp(&pid, strings[0], NULL, attr, argv, envp);
+      reply.duration = now() - start;
+      reply.pid = (reply.error ? -1 : pid);
+
+      environ = old;
+   }
+
+   free(strings);
+   write_full(fd, &reply, sizeof(reply));
+}
+
+static void
+launcher_run(int fd)
+{
+   // Spawned programs are reaped automatically
+   signal(SIGCHLD, SIG_IGN);
+
+   // Programs start with default signal handling and nothing blocked, as with wlc_exec
+   sigset_t all, none;
+   sigfillset(&all);
+   sigemptyset(&none);
+
+   posix_spawnattr_t attr;
+   short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+#ifdef POSIX_SPAWN_SETSID
+   flags |= POSIX_SPAWN_SETSID;
+#endif
+
+   if (posix_spawnattr_init(&attr) != 0)
+      _exit(EXIT_FAILURE);
+
+   posix_spawnattr_setsigdefault(&attr, &all);
+   posix_spawnattr_setsigmask(&attr, &none);
+   posix_spawnattr_setflags(&attr, flags);
+
+   struct request req;
+   while (read_full(fd, &req, sizeof(req))) {
+      // Every string takes at least a byte, which bounds the counts as well
+      if (req.size > SPAWN_MAX_REQUEST || req.argc + (uint64_t)req.envc + 1 > req.size)
+         break;
+
+      char *data;
+      if (!(data = malloc(req.size)))
+         break;
+
+      if (!read_full(fd, data, req.size)) {
+         free(data);
+         break;
+      }
+
+      launcher_handle(fd, &attr, &req, data);
+      free(data);
+   }
+
+   posix_spawnattr_destroy(&attr);
+   _exit(EXIT_SUCCESS);
+}
+
+static int
+launcher_readable(int fd, uint32_t mask, void *arg)
+{
+   (void)arg;
+
+   for (;;) {
+      const ssize_t r = recv(fd, launcher.partial.data + launcher.partial.size, sizeof(launcher.partial.data) - launcher.partial.size, MSG_DONTWAIT);
+
+      if (r < 0 && errno == EINTR)
+         continue;
+
+      if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         break;
+
+      if (r <= 0) {
+         mask |= WLC_EVENT_HANGUP;
+         break;
+      }
+
+      if ((launcher.partial.size += r) < sizeof(launcher.partial.data))
+         continue;
+
+      struct reply reply;
+      memcpy(&reply, launcher.partial.data, sizeof(reply));
+      launcher.partial.size = 0;
+
+      const uint64_t latency = now() - reply.stamp;
+      histogram_record(&launcher.latency, latency);
+
+      if (reply.error) {
+         plog(0, PLOG_WARN, "Spawning failed: %s", strerror(reply.error));
+      } else {
+         plog(0, PLOG_DEBUG, "Spawned pid %d in %.2f ms (posix_spawn %.2f ms)", reply.pid, latency / 1e6, reply.duration / 1e6);
+      }
+   }
+
+   if (mask & (WLC_EVENT_HANGUP | WLC_EVENT_ERROR)) {
+      plog(0, PLOG_WARN, "Launcher process is gone, programs are spawned with wlc_exec");
+      launcher_release();
+   }
+
+   return 0;
+}
+
+bool
+launcher_setup(void)
+{
+   assert(launcher.fd < 0);
+
+   int fds[2];
+   if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0)
+      return false;
+
+   pid_t pid;
+   if ((pid = fork()) < 0) {
+      close(fds[0]);
+      close(fds[1]);
+      return false;
+   }
+
+   if (pid == 0) {
+      close(fds[0]);
+
+      // XXX: Compositor drops privileges later, in wlc_init, launcher must not keep them
+      if ((getegid() != getgid() && setgid(getgid()) != 0) || (geteuid() != getuid() && setuid(getuid()) != 0))
+         _exit(EXIT_FAILURE);
+
+      launcher_run(fds[1]);
+   }
+
+   close(fds[1]);
+   launcher.fd = fds[0];
+   launcher.pid = pid;
+   return true;
+}
+
+bool
+launcher_listen(void)
+{
+   if (launcher.fd < 0)
+      return false;
+
+   return ((launcher.source = wlc_event_loop_add_fd(launcher.fd, WLC_EVENT_READABLE, launcher_readable, NULL)) != NULL);
+}
+
+void
+launcher_release(void)
+{
+   if (launcher.source)
+      wlc_event_source_remove(launcher.source);
+
+   if (launcher.fd >= 0) {
+      // launcher exits when it sees end of the stream
+      close(launcher.fd);
+      waitpid(launcher.pid, NULL, 0);
+   }
+
+   launcher.source = NULL;
+   launcher.partial.size = 0;
+   launcher.fd = -1;
+}
+
+bool
+launcher_spawn(const char *file, char *const argv[])
+{
+   assert(file && argv);
+
+   if (launcher.fd < 0)
+      goto fallback;
+
+   struct request req = {0};
+   req.size = strlen(file) + 1;
+
+   for (; argv[req.argc]; ++req.argc)
+      req.size += strlen(argv[req.argc]) + 1;
+
+   for (; environ && environ[req.envc]; ++req.envc)
+      req.size += strlen(environ[req.envc]) + 1;
+
+   if (req.size > SPAWN_MAX_REQUEST)
+      goto fallback;
+
+   uint8_t *buffer;
+   if (!(buffer = malloc(sizeof(req) + req.size)))
+      goto fallback;
+
+   uint8_t *p = buffer + sizeof(req);
+   {
+      const size_t len = strlen(file) + 1;
+      memcpy(p, file, len);
+      p += len;
+   }
+
+   for (uint32_t i = 0; i < req.argc; ++i) {
+      const size_t len = strlen(argv[i]) + 1;
+      memcpy(p, argv[i], len);
+      p += len;
+   }
+
+   for (uint32_t i = 0; i < req.envc; ++i) {
+      const size_t len = strlen(environ[i]) + 1;
+      memcpy(p, environ[i], len);
+      p += len;
+   }
+
+   req.stamp = now();
+   memcpy(buffer, &req, sizeof(req));
+
+   const bool sent = write_full(launcher.fd, buffer, sizeof(req) + req.size);
+   free(buffer);
+
+   if (sent)
+      return true;
+
+   plog(0, PLOG_WARN, "Could not send request to launcher process, programs are spawned with wlc_exec");
+   launcher_release();
+
+fallback:
+   wlc_exec(file, argv);
+   return true;
+}
+
+void
+launcher_dump_latency(void)
+{
+   const struct histogram *l = &launcher.latency;
+   if (!l->count)
+      return;
+
+   plog(0, PLOG_INFO, "Spawn latencies (spawns, mean, p50, p90, p99, max in milliseconds):");
+   plog(0, PLOG_INFO, "%" PRIu64 " spawns, %.2f, %.2f, %.2f, %.2f, %.2f", l->count, l->sum / (double)l->count / 1e6,
+         histogram_percentile(l, 50.0) / 1e6, histogram_percentile(l, 90.0) / 1e6, histogram_percentile(l, 99.0) / 1e6, l->max / 1e6);
+}
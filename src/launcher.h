@@ -0,0 +1,24 @@
+#ifndef __orbment_launcher_h__
+#define __orbment_launcher_h__
+
+#include <orbment/defines.h>
+#include <stdbool.h>
+
+/**
+ * Forks the launcher process, that runs programs for the compositor with posix_spawn.
+ * Must be called first thing in main, before threads or large mappings exist.
+ */
+bool launcher_setup(void);
+
+/** Starts reading launcher replies, needs wlc event loop. */
+bool launcher_listen(void);
+
+void launcher_release(void);
+
+/** Runs file with argv through launcher, falls back to wlc_exec if there is no launcher. */
+PNONULL bool launcher_spawn(const char *file, char *const argv[]);
+
+/** Logs spawn latencies. */
+void launcher_dump_latency(void);
+
+#endif /* __orbment_launcher_h__ */
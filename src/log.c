@@ -1,52 +1,460 @@
 #include "log.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <time.h>
 #include <assert.h>
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <sys/time.h>
 #include <wlc/wlc.h>
+#include <chck/math/math.h>
 #include "plugin.h"
+#include "binlog.h"
 
-#if defined(__linux__)
-#  include <linux/version.h>
-// FIXME: detect runtime instead
-#  if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 4, 0)
-#     include <sys/prctl.h> /* for yama */
-#     define HAS_YAMA_PRCTL 1
-#  endif
-#endif
+enum {
+   // must be power of two
+   LOG_ENTRIES = 1024,
+   // messages longer than this are allocated from heap
+   LOG_ENTRY_SIZE = 256,
+   // messages longer than this are truncated
+   LOG_MESSAGE_MAX = 64 * 1024,
+   // must be power of two, format strings and prefixes recorded in binary log
+   LOG_STRINGS = 4096,
+};
+
+/**
+ * Slot in the log ring.
+ * Sequence number tells whether the slot is free for producer, or ready for consumer.
+ */
+struct log_entry {
+   size_t sequence;
+   struct timeval tv;
+   char *heap;
+   size_t len;
+   char data[LOG_ENTRY_SIZE];
+};
 
 static struct {
    FILE *file;
+
+   // Binary log, see binlog.h
+   // Ids of strings already written in this generation are kept in lock-free hash set.
+   struct {
+      uint64_t strings[LOG_STRINGS];
+      uint16_t generation;
+      bool enabled;
+   } binary;
+
+   // Lock-free multi-producer multi-consumer ring, drained by the writer thread.
+   // Fixed size, when full new messages are dropped and counted.
+   struct {
+      struct log_entry entries[LOG_ENTRIES];
+      size_t head, tail, dropped;
+      pthread_t thread;
+      sem_t pending;
+      bool running, stop;
+   } async;
+
+   // Precomputed for log_flush_crash, which may only use async-signal-safe calls
+   struct {
+      long utc_offset;
+      int fd;
+      bool timestamps;
+   } crash;
 } logger;
 
 static inline void
-log_timestamp(FILE *out)
+log_timestamp(FILE *out, const struct timeval *tv)
+{
+   assert(out && tv);
+
+   // localtime and strftime are only called once per second
+   static struct {
+      time_t sec;
+      char time[16];
+      bool valid;
+   } cache;
+
+   if (!cache.valid || cache.sec != tv->tv_sec) {
+      struct tm brokendown_time;
+      if (!localtime_r(&tv->tv_sec, &brokendown_time)) {
+         fprintf(out, "[(NULL)localtime] ");
+         return;
+      }
+
+      // offset changes with daylight saving time
+      __atomic_store_n(&logger.crash.utc_offset, brokendown_time.tm_gmtoff, __ATOMIC_RELAXED);
+
+      static int cached_tm_mday;
+      if (brokendown_time.tm_mday != cached_tm_mday) {
+         char string[128];
+         strftime(string, sizeof(string), "%Y-%m-%d %Z", &brokendown_time);
+         fprintf(out, "Date: %s\n", string);
+         cached_tm_mday = brokendown_time.tm_mday;
+      }
+
+      strftime(cache.time, sizeof(cache.time), "%H:%M:%S", &brokendown_time);
+      cache.sec = tv->tv_sec;
+      cache.valid = true;
+   }
+
+   fprintf(out, "[%s.%03li] ", cache.time, (long)tv->tv_usec / 1000);
+}
+
+static inline FILE*
+log_out(void)
+{
+   return (logger.file ? logger.file : stderr);
+}
+
+static inline bool
+log_has_timestamps(FILE *out)
+{
+   return (!logger.binary.enabled && out != stderr && out != stdout);
+}
+
+static size_t
+log_header(char *buf, size_t size, enum plugin_log_type type, const char *prefix)
+{
+   static const char *types[] = {
+      [PLOG_WARN] = "(WARN) ",
+      [PLOG_ERROR] = "(ERROR) ",
+      [PLOG_DEBUG] = "(DEBUG) ",
+      [PLOG_TRACE] = "(TRACE) ",
+   };
+
+   const char *t = ((size_t)type < sizeof(types) / sizeof(types[0]) && types[type] ? types[type] : "");
+   const int header = snprintf(buf, size, "%s%s%s", t, (prefix ? prefix : ""), (prefix ? ": " : ""));
+   return (header > 0 ? (size_t)header : 0);
+}
+
+static size_t
+log_format(char *buf, size_t size, enum plugin_log_type type, const char *prefix, const char *fmt, va_list ap)
+{
+   assert(fmt);
+
+   const size_t header = log_header(buf, size, type, prefix);
+   const size_t off = chck_minsz(header, size);
+   const int message = vsnprintf(buf + off, size - off, fmt, ap);
+   const size_t len = header + (message > 0 ? (size_t)message : 0) + 1;
+
+   if (len <= size)
+      buf[len - 1] = '\n';
+
+   return len;
+}
+
+static void
+log_write_sync(enum plugin_log_type type, const char *prefix, const char *fmt, va_list ap)
+{
+   FILE *out = log_out();
+
+   if (log_has_timestamps(out)) {
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+      log_timestamp(out, &tv);
+   }
+
+   char buf[LOG_ENTRY_SIZE];
+   va_list copy;
+   va_copy(copy, ap);
+   const size_t len = log_format(buf, sizeof(buf), type, prefix, fmt, copy);
+   va_end(copy);
+
+   if (len <= sizeof(buf)) {
+      fwrite(buf, 1, len, out);
+   } else {
+      // ap is untouched, only the copy was consumed
+      const size_t header = log_header(buf, sizeof(buf), type, prefix);
+      fwrite(buf, 1, chck_minsz(header, sizeof(buf) - 1), out);
+      vfprintf(out, fmt, ap);
+      fputc('\n', out);
+   }
+
+   fflush(out);
+}
+
+static struct log_entry*
+log_claim(size_t *out_pos)
+{
+   assert(out_pos);
+
+   size_t pos = __atomic_load_n(&logger.async.head, __ATOMIC_RELAXED);
+   for (;;) {
+      struct log_entry *e = &logger.async.entries[pos & (LOG_ENTRIES - 1)];
+      const intptr_t diff = (intptr_t)__atomic_load_n(&e->sequence, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+
+      if (diff == 0) {
+         if (__atomic_compare_exchange_n(&logger.async.head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            *out_pos = pos;
+            return e;
+         }
+      } else if (diff < 0) {
+         return NULL;
+      } else {
+         pos = __atomic_load_n(&logger.async.head, __ATOMIC_RELAXED);
+      }
+   }
+}
+
+static struct log_entry*
+log_consume(size_t *out_pos)
+{
+   assert(out_pos);
+
+   size_t pos = __atomic_load_n(&logger.async.tail, __ATOMIC_RELAXED);
+   for (;;) {
+      struct log_entry *e = &logger.async.entries[pos & (LOG_ENTRIES - 1)];
+      const intptr_t diff = (intptr_t)__atomic_load_n(&e->sequence, __ATOMIC_ACQUIRE) - (intptr_t)(pos + 1);
+
+      if (diff == 0) {
+         if (__atomic_compare_exchange_n(&logger.async.tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            *out_pos = pos;
+            return e;
+         }
+      } else if (diff < 0) {
+         return NULL;
+      } else {
+         pos = __atomic_load_n(&logger.async.tail, __ATOMIC_RELAXED);
+      }
+   }
+}
+
+static void
+log_release_entry(struct log_entry *e, size_t pos)
+{
+   assert(e);
+   free(e->heap);
+   e->heap = NULL;
+   __atomic_store_n(&e->sequence, pos + LOG_ENTRIES, __ATOMIC_RELEASE);
+}
+
+static void
+log_write_dropped(FILE *out)
 {
    assert(out);
 
-   struct timeval tv;
-   struct tm *brokendown_time;
-   gettimeofday(&tv, NULL);
+   size_t dropped;
+   if (!(dropped = __atomic_exchange_n(&logger.async.dropped, 0, __ATOMIC_RELAXED)))
+      return;
 
-   if (!(brokendown_time = localtime(&tv.tv_sec))) {
-      fprintf(out, "[(NULL)localtime] ");
+   if (logger.binary.enabled) {
+      uint8_t buf[32];
+      fwrite(buf, 1, binlog_encode_dropped(buf, sizeof(buf), dropped), out);
       return;
    }
 
-   char string[128];
-   static int cached_tm_mday;
-   if (brokendown_time->tm_mday != cached_tm_mday) {
-      strftime(string, sizeof(string), "%Y-%m-%d %Z", brokendown_time);
-      fprintf(out, "Date: %s\n", string);
-      cached_tm_mday = brokendown_time->tm_mday;
+   if (log_has_timestamps(out)) {
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+      log_timestamp(out, &tv);
+   }
+
+   fprintf(out, "(WARN) Log buffer was full, dropped %zu messages\n", dropped);
+}
+
+static void
+log_drain(FILE *out)
+{
+   assert(out);
+
+   size_t pos;
+   struct log_entry *e;
+   while ((e = log_consume(&pos))) {
+      if (log_has_timestamps(out))
+         log_timestamp(out, &e->tv);
+
+      fwrite((e->heap ? e->heap : e->data), 1, e->len, out);
+      log_release_entry(e, pos);
+   }
+
+   log_write_dropped(out);
+   fflush(out);
+}
+
+static void*
+log_writer(void *arg)
+{
+   (void)arg;
+
+   for (;;) {
+      while (sem_wait(&logger.async.pending) != 0);
+      log_drain(log_out());
+
+      if (__atomic_load_n(&logger.async.stop, __ATOMIC_ACQUIRE))
+         break;
+   }
+
+   log_drain(log_out());
+   return NULL;
+}
+
+static bool
+log_write_async(enum plugin_log_type type, const char *prefix, const char *fmt, va_list ap)
+{
+   size_t pos;
+   struct log_entry *e;
+   if (!(e = log_claim(&pos))) {
+      __atomic_add_fetch(&logger.async.dropped, 1, __ATOMIC_RELAXED);
+      return true;
+   }
+
+   gettimeofday(&e->tv, NULL);
+
+   va_list copy;
+   va_copy(copy, ap);
+   e->len = log_format(e->data, sizeof(e->data), type, prefix, fmt, copy);
+   va_end(copy);
+
+   if (e->len > sizeof(e->data)) {
+      e->len = chck_minsz(e->len, LOG_MESSAGE_MAX);
+      if ((e->heap = malloc(e->len))) {
+         log_format(e->heap, e->len, type, prefix, fmt, ap);
+         e->heap[e->len - 1] = '\n';
+      } else {
+         e->len = sizeof(e->data);
+         e->data[e->len - 1] = '\n';
+      }
+   }
+
+   __atomic_store_n(&e->sequence, pos + 1, __ATOMIC_RELEASE);
+   sem_post(&logger.async.pending);
+   return true;
+}
+
+static bool
+log_push(const struct timeval *tv, const void *data, size_t len)
+{
+   assert(tv && data);
+
+   if (!__atomic_load_n(&logger.async.running, __ATOMIC_ACQUIRE)) {
+      const bool written = (fwrite(data, 1, len, log_out()) == len);
+      fflush(log_out());
+      return written;
+   }
+
+   size_t pos;
+   struct log_entry *e;
+   if (len > LOG_MESSAGE_MAX || !(e = log_claim(&pos))) {
+      __atomic_add_fetch(&logger.async.dropped, 1, __ATOMIC_RELAXED);
+      return false;
+   }
+
+   e->tv = *tv;
+   e->len = len;
+
+   if (len <= sizeof(e->data)) {
+      memcpy(e->data, data, len);
+   } else if ((e->heap = malloc(len))) {
+      memcpy(e->heap, data, len);
+   } else {
+      e->len = 0;
+   }
+
+   // entry belongs to the writer once published
+   const bool pushed = (e->len > 0);
+   __atomic_store_n(&e->sequence, pos + 1, __ATOMIC_RELEASE);
+   sem_post(&logger.async.pending);
+   return pushed;
+}
+
+static bool
+log_binary_intern(uint64_t key)
+{
+   // Returns true if the string was already recorded this generation.
+   // When the set is full, strings are recorded again for every message.
+   for (size_t n = 0, i = (key >> 3) & (LOG_STRINGS - 1); n < LOG_STRINGS; ++n, i = (i + 1) & (LOG_STRINGS - 1)) {
+      uint64_t cur = __atomic_load_n(&logger.binary.strings[i], __ATOMIC_ACQUIRE);
+
+      if (cur == key)
+         return true;
+
+      if (cur == 0) {
+         if (__atomic_compare_exchange_n(&logger.binary.strings[i], &cur, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return false;
+
+         if (cur == key)
+            return true;
+      }
+   }
+
+   return false;
+}
+
+static void
+log_binary_forget(uint64_t key)
+{
+   // Frees the slot of a string whose record never made it to the log, so the next message records it again.
+   // The hole may make a later key get recorded twice, which the decoder handles.
+   for (size_t n = 0, i = (key >> 3) & (LOG_STRINGS - 1); n < LOG_STRINGS; ++n, i = (i + 1) & (LOG_STRINGS - 1)) {
+      uint64_t cur = key;
+      if (__atomic_compare_exchange_n(&logger.binary.strings[i], &cur, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || cur == 0)
+         return;
+   }
+}
+
+static void
+log_binary_string(const struct timeval *tv, const char *str, uint16_t generation)
+{
+   assert(tv && str);
+
+   const uint64_t key = binlog_string_id(str, generation);
+   if (log_binary_intern(key))
+      return;
+
+   bool pushed = false;
+   uint8_t buf[LOG_ENTRY_SIZE];
+   const size_t len = binlog_encode_string(buf, sizeof(buf), str, generation);
+
+   if (len <= sizeof(buf)) {
+      pushed = log_push(tv, buf, len);
+   } else {
+      uint8_t *heap;
+      if ((heap = malloc(len))) {
+         binlog_encode_string(heap, len, str, generation);
+         pushed = log_push(tv, heap, len);
+         free(heap);
+      }
    }
 
-   strftime(string, sizeof(string), "%H:%M:%S", brokendown_time);
-   fprintf(out, "[%s.%03li] ", string, tv.tv_usec / 1000);
+   if (!pushed)
+      log_binary_forget(key);
+}
+
+static void
+log_write_binary(enum plugin_log_type type, const char *prefix, const char *fmt, va_list ap)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+
+   const uint16_t generation = __atomic_load_n(&logger.binary.generation, __ATOMIC_ACQUIRE);
+
+   if (prefix)
+      log_binary_string(&tv, prefix, generation);
+
+   log_binary_string(&tv, fmt, generation);
+
+   uint8_t buf[LOG_ENTRY_SIZE];
+   const size_t len = binlog_encode_message(buf, sizeof(buf), tv.tv_sec, tv.tv_usec, type, fmt, prefix, generation, ap);
+
+   if (len <= sizeof(buf)) {
+      log_push(&tv, buf, len);
+   } else {
+      uint8_t *heap;
+      if (len > LOG_MESSAGE_MAX || !(heap = malloc(len))) {
+         __atomic_add_fetch(&logger.async.dropped, 1, __ATOMIC_RELAXED);
+         return;
+      }
+
+      binlog_encode_message(heap, len, tv.tv_sec, tv.tv_usec, type, fmt, prefix, generation, ap);
+      log_push(&tv, heap, len);
+      free(heap);
+   }
 }
 
 static inline void
@@ -57,96 +465,160 @@ cb_log(enum wlc_log_type type, const char *str)
    plog(0, ntype, "%s: %s", (type == WLC_LOG_WAYLAND ? "wayland" : "wlc"), str);
 }
 
+void
+log_forget_strings(void)
+{
+   if (!logger.binary.enabled)
+      return;
+
+   // ids of the new generation never match the old ones, clearing just frees the slots
+   __atomic_add_fetch(&logger.binary.generation, 1, __ATOMIC_ACQ_REL);
+   for (size_t i = 0; i < LOG_STRINGS; ++i)
+      __atomic_store_n(&logger.binary.strings[i], 0, __ATOMIC_RELEASE);
+}
+
 void
 logv(enum plugin_log_type type, const char *prefix, const char *fmt, va_list ap)
 {
    assert(fmt);
 
-   FILE *out = (logger.file ? logger.file : stderr);
-
-   if (out != stderr && out != stdout)
-      log_timestamp(out);
+   if (logger.binary.enabled) {
+      log_write_binary(type, prefix, fmt, ap);
+   } else if (__atomic_load_n(&logger.async.running, __ATOMIC_ACQUIRE)) {
+      log_write_async(type, prefix, fmt, ap);
+   } else {
+      log_write_sync(type, prefix, fmt, ap);
+   }
+}
 
-   switch (type) {
-      case PLOG_WARN:
-         fprintf(out, "(WARN) ");
-         break;
-      case PLOG_ERROR:
-         fprintf(out, "(ERROR) ");
-         break;
+void
+log_set_file(const char *path, bool binary)
+{
+   logger.file = (path ? fopen(path, (binary ? "ab" : "a")) : NULL);
 
-      default: break;
+   if ((logger.binary.enabled = (logger.file && binary))) {
+      memset(logger.binary.strings, 0, sizeof(logger.binary.strings));
+      uint8_t buf[32];
+      fwrite(buf, 1, binlog_encode_session(buf, sizeof(buf)), logger.file);
    }
 
-   if (prefix)
-      fprintf(out, "%s: ", prefix);
-
-   vfprintf(out, fmt, ap);
-   fprintf(out, "\n");
-   fflush(out);
+   logger.crash.fd = fileno(log_out());
+   logger.crash.timestamps = log_has_timestamps(log_out());
 }
 
-void
-log_set_file(const char *path)
+static bool
+log_start_writer(void)
 {
-   logger.file = (path ? fopen(path, "a") : NULL);
+   for (size_t i = 0; i < LOG_ENTRIES; ++i)
+      logger.async.entries[i].sequence = i;
+
+   logger.async.head = logger.async.tail = logger.async.dropped = 0;
+   logger.async.stop = false;
+
+   if (sem_init(&logger.async.pending, 0, 0) != 0)
+      return false;
+
+   // Signals must be handled by the main thread.
+   sigset_t all, old;
+   sigfillset(&all);
+   pthread_sigmask(SIG_SETMASK, &all, &old);
+   const bool created = (pthread_create(&logger.async.thread, NULL, log_writer, NULL) == 0);
+   pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+   if (!created) {
+      sem_destroy(&logger.async.pending);
+      return false;
+   }
+
+   __atomic_store_n(&logger.async.running, true, __ATOMIC_RELEASE);
+   return true;
 }
 
 void
 log_open(void)
 {
    wlc_log_set_handler(cb_log);
+
+   struct tm brokendown_time;
+   const time_t now = time(NULL);
+   logger.crash.utc_offset = (localtime_r(&now, &brokendown_time) ? brokendown_time.tm_gmtoff : 0);
+   logger.crash.fd = fileno(log_out());
+   logger.crash.timestamps = log_has_timestamps(log_out());
+
+   if (!log_start_writer()) {
+      plog(0, PLOG_WARN, "Could not start log writer thread, logging synchronously");
+      return;
+   }
+
+   atexit(log_close);
 }
 
-void
-log_close(void)
+/** "[HH:MM:SS.mmm] " with integer math only, ts must hold 16 bytes. */
+static size_t
+log_crash_timestamp(char *ts, const struct timeval *tv)
 {
-   if (logger.file && logger.file != stdout && logger.file != stderr)
-      fclose(logger.file);
+   assert(ts && tv);
 
-   logger.file = NULL;
+   const long day = 24 * 60 * 60;
+   const long secs = ((long)((tv->tv_sec + __atomic_load_n(&logger.crash.utc_offset, __ATOMIC_RELAXED)) % day) + day) % day;
+   const long ms = (long)tv->tv_usec / 1000;
+   const long fields[] = { secs / 3600, secs / 60 % 60, secs % 60 };
+
+   size_t len = 0;
+   ts[len++] = '[';
+   for (uint32_t i = 0; i < 3; ++i) {
+      ts[len++] = '0' + fields[i] / 10;
+      ts[len++] = '0' + fields[i] % 10;
+      ts[len++] = (i < 2 ? ':' : '.');
+   }
+
+   ts[len++] = '0' + ms / 100;
+   ts[len++] = '0' + ms / 10 % 10;
+   ts[len++] = '0' + ms % 10;
+   ts[len++] = ']';
+   ts[len++] = ' ';
+   return len;
 }
 
 void
-log_backtrace(void)
+log_flush_crash(void)
 {
-   if (clearenv() != 0)
+   if (!__atomic_load_n(&logger.async.running, __ATOMIC_ACQUIRE))
       return;
 
-   /* GDB */
-#if defined(__linux__) || defined(__APPLE__)
-   pid_t child_pid = fork();
-
-#if HAS_YAMA_PRCTL
-   /* tell yama that we allow our child_pid to trace our process */
-   if (child_pid > 0) {
-      if (!prctl(PR_GET_DUMPABLE)) {
-         plog(0, PLOG_WARN, "Compositor binary is suid/sgid, most likely since you are running from TTY.");
-         plog(0, PLOG_WARN, "Kernel ptracing security policy does not allow attaching to suid/sgid processes.");
-         plog(0, PLOG_WARN, "If you don't get backtrace below, try `setcap cap_sys_ptrace=eip gdb` temporarily.");
-      }
-      prctl(PR_SET_DUMPABLE, 1);
-      prctl(PR_SET_PTRACER, child_pid);
-   }
-#endif
-
-   if (child_pid < 0) {
-      plog(0, PLOG_ERROR, "Fork failed for gdb backtrace");
-   } else if (child_pid == 0) {
-      /*
-       * NOTE: gdb-7.8 does not seem to work with this,
-       *       either downgrade to 7.7 or use gdb from master.
-       */
-
-      /* sed -n '/bar/h;/bar/!H;$!b;x;p' (another way, if problems) */
-      char buf[255];
-      const int fd = fileno((logger.file ? logger.file : stderr));
-      snprintf(buf, sizeof(buf) - 1, "gdb -p %d -n -batch -ex bt 2>/dev/null | sed -n '/<signal handler/{n;x;b};H;${x;p}' 1>&%d", getppid(), fd);
-      execl("/bin/sh", "/bin/sh", "-c", buf, NULL);
-      plog(0, PLOG_ERROR, "Failed to launch gdb for backtrace");
-      _exit(EXIT_FAILURE);
-   } else {
-      waitpid(child_pid, NULL, 0);
+   // Writer thread may be stuck, or the process is about to die.
+   // Consume the rest of the ring here and write it straight to the descriptor.
+   const int fd = logger.crash.fd;
+
+   size_t pos;
+   struct log_entry *e;
+   while ((e = log_consume(&pos))) {
+      char ts[16];
+      if (logger.crash.timestamps && write(fd, ts, log_crash_timestamp(ts, &e->tv)) < 0)
+         break;
+
+      if (write(fd, (e->heap ? e->heap : e->data), e->len) < 0)
+         break;
+
+      // heap is leaked on purpose, free is not safe here
+      __atomic_store_n(&e->sequence, pos + LOG_ENTRIES, __ATOMIC_RELEASE);
+   }
+}
+
+void
+log_close(void)
+{
+   if (__atomic_load_n(&logger.async.running, __ATOMIC_ACQUIRE)) {
+      __atomic_store_n(&logger.async.stop, true, __ATOMIC_RELEASE);
+      sem_post(&logger.async.pending);
+      pthread_join(logger.async.thread, NULL);
+      __atomic_store_n(&logger.async.running, false, __ATOMIC_RELEASE);
+      sem_destroy(&logger.async.pending);
    }
-#endif
+
+   if (logger.file && logger.file != stdout && logger.file != stderr)
+      fclose(logger.file);
+
+   logger.file = NULL;
+   logger.binary.enabled = false;
 }
@@ -3,13 +3,20 @@
 
 #include <orbment/defines.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 enum plugin_log_type;
 
-void log_set_file(const char *path);
+/** binary selects the binary log format, see binlog.h */
+void log_set_file(const char *path, bool binary);
 void log_open(void);
 void log_close(void);
-void log_backtrace(void);
+
+/** writes out pending asynchronous log messages, for crash handlers. */
+void log_flush_crash(void);
+
+/** strings logged so far may be freed, binary log records them again under new ids. */
+void log_forget_strings(void);
 
 /** this is exposed for plugin.c, use plog instead. */
 PNONULLV(3) void logv(enum plugin_log_type type, const char *prefix, const char *fmt, va_list ap);
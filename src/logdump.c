@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <assert.h>
+#include <chck/lut/lut.h>
+#include <chck/string/string.h>
+#include <orbment/plugin.h>
+#include "binlog.h"
+
+/**
+ * Formats binary log written with orbment --log-binary.
+ * Output is the same as with --log.
+ */
+
+struct reader {
+   const uint8_t *data;
+   size_t size, off;
+   bool error;
+};
+
+struct session {
+   // string id -> struct chck_string
+   struct chck_hash_table strings;
+   struct {
+      int64_t sec;
+      uint32_t usec;
+   } last;
+   int mday;
+};
+
+static bool
+get(struct reader *r, void *out, size_t len)
+{
+   assert(r && out);
+
+   if (r->error || r->size - r->off < len) {
+      r->error = true;
+      memset(out, 0, len);
+      return false;
+   }
+
+   memcpy(out, r->data + r->off, len);
+   r->off += len;
+   return true;
+}
+
+static uint8_t
+get_u8(struct reader *r)
+{
+   uint8_t v;
+   get(r, &v, sizeof(v));
+   return v;
+}
+
+static uint32_t
+get_u32(struct reader *r)
+{
+   uint32_t v;
+   get(r, &v, sizeof(v));
+   return v;
+}
+
+static uint64_t
+get_u64(struct reader *r)
+{
+   uint64_t v;
+   get(r, &v, sizeof(v));
+   return v;
+}
+
+static const char*
+string_for_id(struct session *s, uint64_t id)
+{
+   assert(s);
+   const struct chck_string *str = chck_hash_table_str_get(&s->strings, (const char*)&id, sizeof(id));
+   return (str && !chck_string_is_empty(str) ? str->data : NULL);
+}
+
+static void
+release_strings(struct session *s)
+{
+   assert(s);
+   chck_hash_table_for_each_call(&s->strings, chck_string_release);
+   chck_hash_table_release(&s->strings);
+}
+
+static void
+print_timestamp(struct session *s, int64_t sec, uint32_t usec)
+{
+   assert(s);
+
+   const time_t t = sec;
+   struct tm brokendown_time;
+   if (!localtime_r(&t, &brokendown_time)) {
+      printf("[(NULL)localtime] ");
+      return;
+   }
+
+   char string[128];
+   if (brokendown_time.tm_mday != s->mday) {
+      strftime(string, sizeof(string), "%Y-%m-%d %Z", &brokendown_time);
+      printf("Date: %s\n", string);
+      s->mday = brokendown_time.tm_mday;
+   }
+
+   strftime(string, sizeof(string), "%H:%M:%S", &brokendown_time);
+   printf("[%s.%03li] ", string, (long)usec / 1000);
+}
+
+static void
+print_argument(const struct binlog_spec *spec, struct reader *r)
+{
+   assert(spec && r);
+
+   // rebuild the conversion with our own length modifier
+   char conv[64];
+   int len = snprintf(conv, sizeof(conv), "%%%.*s", (int)spec->flags.len, spec->flags.data);
+
+   if (spec->width_arg) {
+      len += snprintf(conv + len, sizeof(conv) - len, "%" PRId64, (int64_t)get_u64(r));
+   } else {
+      len += snprintf(conv + len, sizeof(conv) - len, "%.*s", (int)spec->width.len, spec->width.data);
+   }
+
+   if (spec->precision_arg) {
+      len += snprintf(conv + len, sizeof(conv) - len, ".%" PRId64, (int64_t)get_u64(r));
+   } else if (spec->has_precision) {
+      len += snprintf(conv + len, sizeof(conv) - len, ".%.*s", (int)spec->precision.len, spec->precision.data);
+   }
+
+   const bool integer = ((spec->arg == BINLOG_ARG_INT || spec->arg == BINLOG_ARG_UINT) && spec->conversion != 'c');
+   snprintf(conv + len, sizeof(conv) - len, "%s%c", (integer ? "ll" : ""), spec->conversion);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+   switch (spec->arg) {
+      case BINLOG_ARG_INT:
+         if (spec->conversion == 'c') {
+            printf(conv, (int)get_u64(r));
+         } else {
+            printf(conv, (long long)get_u64(r));
+         }
+         break;
+
+      case BINLOG_ARG_UINT:
+         printf(conv, (unsigned long long)get_u64(r));
+         break;
+
+      case BINLOG_ARG_DOUBLE: {
+         double d;
+         get(r, &d, sizeof(d));
+         printf(conv, d);
+      }
+      break;
+
+      case BINLOG_ARG_STRING: {
+         const uint32_t slen = get_u32(r);
+         char *str;
+         if (slen > r->size - r->off || !(str = calloc(1, slen + 1))) {
+            r->error = true;
+            break;
+         }
+
+         get(r, str, slen);
+         printf(conv, str);
+         free(str);
+      }
+      break;
+
+      case BINLOG_ARG_POINTER:
+         printf(conv, (void*)(uintptr_t)get_u64(r));
+         break;
+
+      case BINLOG_ARG_COUNT:
+      case BINLOG_ARG_NONE:
+         break;
+   }
+#pragma GCC diagnostic pop
+}
+
+static void
+print_message(struct session *s, struct reader *r)
+{
+   assert(s && r);
+
+   s->last.sec = get_u64(r);
+   s->last.usec = get_u32(r);
+   const uint8_t type = get_u8(r);
+   const uint64_t fmt_id = get_u64(r), prefix_id = get_u64(r);
+
+   print_timestamp(s, s->last.sec, s->last.usec);
+
+   static const char *types[] = {
+      [PLOG_WARN] = "(WARN) ",
+      [PLOG_ERROR] = "(ERROR) ",
+      [PLOG_DEBUG] = "(DEBUG) ",
+      [PLOG_TRACE] = "(TRACE) ",
+   };
+
+   if (type < sizeof(types) / sizeof(types[0]) && types[type])
+      printf("%s", types[type]);
+
+   if (prefix_id) {
+      const char *prefix = string_for_id(s, prefix_id);
+      printf("%s: ", (prefix ? prefix : "(unknown)"));
+   }
+
+   const char *fmt;
+   if (!(fmt = string_for_id(s, fmt_id))) {
+      printf("(format %#" PRIx64 " was not recorded)\n", fmt_id);
+      return;
+   }
+
+   const char *start, *next;
+   struct binlog_spec spec;
+   while ((next = binlog_next_spec(fmt, &start, &spec))) {
+      fwrite(fmt, 1, start - fmt, stdout);
+
+      if (spec.conversion == '%') {
+         putchar('%');
+      } else if (spec.arg == BINLOG_ARG_NONE) {
+         fwrite(start, 1, next - start, stdout);
+      } else {
+         print_argument(&spec, r);
+      }
+
+      fmt = next;
+   }
+
+   printf("%s\n", fmt);
+}
+
+static void
+collect_strings(struct session *s, const uint8_t *data, size_t size)
+{
+   assert(s && data);
+
+   for (size_t off = 0; size - off >= BINLOG_RECORD_HEADER_SIZE;) {
+      struct reader r = { data + off, size - off, 0, false };
+      const uint32_t rsize = get_u32(&r);
+      const uint8_t type = get_u8(&r);
+
+      if (rsize < BINLOG_RECORD_HEADER_SIZE || rsize > size - off || (type == BINLOG_RECORD_SESSION && off > 0))
+         break;
+
+      if (type == BINLOG_RECORD_STRING) {
+         const uint64_t id = get_u64(&r);
+         struct chck_string str = {0};
+         if (rsize >= r.off && chck_string_set_cstr_with_length(&str, (const char*)r.data + r.off, rsize - r.off, true)) {
+            struct chck_string *old;
+            if ((old = chck_hash_table_str_get(&s->strings, (const char*)&id, sizeof(id))))
+               chck_string_release(old);
+            chck_hash_table_str_set(&s->strings, (const char*)&id, sizeof(id), &str);
+         }
+      }
+
+      off += rsize;
+   }
+}
+
+static size_t
+dump_session(const uint8_t *data, size_t size)
+{
+   assert(data);
+
+   struct session s;
+   memset(&s, 0, sizeof(s));
+
+   if (!chck_hash_table(&s.strings, 0, 1024, sizeof(struct chck_string)))
+      return size;
+
+   // Strings may be recorded after messages using them by other threads, so collect them first.
+   collect_strings(&s, data, size);
+
+   size_t off = 0;
+   while (size - off >= BINLOG_RECORD_HEADER_SIZE) {
+      struct reader r = { data + off, size - off, 0, false };
+      const uint32_t rsize = get_u32(&r);
+      const uint8_t type = get_u8(&r);
+
+      if (rsize < BINLOG_RECORD_HEADER_SIZE || rsize > size - off) {
+         fprintf(stderr, "orbment-logdump: truncated or corrupt record at offset %zu\n", off);
+         off = size;
+         break;
+      }
+
+      if (type == BINLOG_RECORD_SESSION && off > 0)
+         break;
+
+      r.size = rsize;
+
+      switch (type) {
+         case BINLOG_RECORD_SESSION:
+            if (get_u32(&r) != BINLOG_MAGIC || get_u32(&r) != BINLOG_VERSION)
+               fprintf(stderr, "orbment-logdump: unknown session header at offset %zu\n", off);
+            break;
+
+         case BINLOG_RECORD_MESSAGE:
+            print_message(&s, &r);
+            break;
+
+         case BINLOG_RECORD_DROPPED:
+            print_timestamp(&s, s.last.sec, s.last.usec);
+            printf("(WARN) Log buffer was full, dropped %" PRIu64 " messages\n", get_u64(&r));
+            break;
+
+         default:
+            break;
+      }
+
+      off += rsize;
+   }
+
+   release_strings(&s);
+   return off;
+}
+
+static uint8_t*
+read_file(const char *path, size_t *out_size)
+{
+   assert(path && out_size);
+
+   FILE *f;
+   if (!(f = fopen(path, "rb")))
+      return NULL;
+
+   size_t size = 0, allocated = 0;
+   uint8_t *data = NULL;
+   for (;;) {
+      if (size == allocated) {
+         uint8_t *tmp;
+         if (!(tmp = realloc(data, (allocated = allocated * 2 + 4096))))
+            goto error0;
+         data = tmp;
+      }
+
+      const size_t read = fread(data + size, 1, allocated - size, f);
+      if (!read)
+         break;
+
+      size += read;
+   }
+
+   if (ferror(f))
+      goto error0;
+
+   fclose(f);
+   *out_size = size;
+   return data;
+
+error0:
+   free(data);
+   fclose(f);
+   return NULL;
+}
+
+int
+main(int argc, char *argv[])
+{
+   if (argc != 2) {
+      fprintf(stderr, "usage: %s FILE\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   size_t size;
+   uint8_t *data;
+   if (!(data = read_file(argv[1], &size))) {
+      fprintf(stderr, "orbment-logdump: could not read %s\n", argv[1]);
+      return EXIT_FAILURE;
+   }
+
+   for (size_t off = 0, used; off < size; off += used) {
+      if (!(used = dump_session(data + off, size - off)))
+         break;
+   }
+
+   free(data);
+   return EXIT_SUCCESS;
+}
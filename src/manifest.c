@@ -0,0 +1,479 @@
+#include "manifest.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <chck/string/string.h>
+#include <chck/xdg/xdg.h>
+#include "plugin.h"
+#include "log.h"
+
+/**
+ * File format, native endian as the cache never leaves the machine:
+ *
+ * MANIFEST_MAGIC, then for each entry
+ *    path, mtime seconds (i64), mtime nanoseconds (i64), size (u64),
+ *    name, description, version, provides, conflicts, requires, after, groups, flags (u8)
+ *
+ * Strings are u32 length and the bytes, length of NOSTRING being NULL.
+ * String arrays are u32 count and the strings.
+ */
+
+static const char MANIFEST_MAGIC[8] = { 'O', 'R', 'B', 'M', 'A', 'N', 0, 3 };
+static const uint32_t NOSTRING = (uint32_t)-1;
+
+enum {
+   FLAG_LAZY = 1 << 0,
+   FLAG_PARALLEL_INIT = 1 << 1,
+};
+
+// plugin_info string arrays, in file order
+#define INFO_ARRAYS(info) { &(info)->provides, &(info)->conflicts, &(info)->requires, &(info)->after, &(info)->groups }
+
+struct reader {
+   const uint8_t *data, *end;
+};
+
+static bool
+get_path(struct chck_string *out_path, bool create_dir)
+{
+   assert(out_path);
+
+   char *tmp;
+   if (!(tmp = xdg_get_path("XDG_CACHE_HOME", ".cache")))
+      return false;
+
+   const bool ret = chck_string_set_format(out_path, "%s/orbment", tmp);
+   free(tmp);
+
+   if (!ret || (create_dir && mkdir(out_path->data, 0755) != 0 && errno != EEXIST))
+      return false;
+
+   return chck_string_set_format(out_path, "%s/plugins.manifest", out_path->data);
+}
+
+static bool
+read_bytes(struct reader *r, void *out, size_t size)
+{
+   assert(r);
+
+   if ((size_t)(r->end - r->data) < size)
+      return false;
+
+   memcpy(out, r->data, size);
+   r->data += size;
+   return true;
+}
+
+static bool
+read_string(struct reader *r, char **out_str)
+{
+   assert(r && out_str);
+
+   uint32_t len;
+   if (!read_bytes(r, &len, sizeof(len)))
+      return false;
+
+   if (len == NOSTRING) {
+      *out_str = NULL;
+      return true;
+   }
+
+   if ((size_t)(r->end - r->data) < len || !(*out_str = malloc(len + 1)))
+      return false;
+
+   memcpy(*out_str, r->data, len);
+   (*out_str)[len] = 0;
+   r->data += len;
+   return true;
+}
+
+static bool
+read_array(struct reader *r, const char ***out_array)
+{
+   assert(r && out_array);
+
+   uint32_t count;
+   if (!read_bytes(r, &count, sizeof(count)))
+      return false;
+
+   // each string takes at least its length
+   if (count == NOSTRING || count > (size_t)(r->end - r->data) / sizeof(uint32_t)) {
+      *out_array = NULL;
+      return (count == NOSTRING);
+   }
+
+   char **array;
+   if (!(array = chck_calloc_of(count + 1, sizeof(char*))))
+      return false;
+
+   *out_array = (const char**)array;
+   for (uint32_t i = 0; i < count; ++i) {
+      if (!read_string(r, &array[i]) || !array[i])
+         return false;
+   }
+
+   return true;
+}
+
+static bool
+write_string(FILE *f, const char *str)
+{
+   const uint32_t len = (str ? strlen(str) : NOSTRING);
+   return (fwrite(&len, sizeof(len), 1, f) == 1 && (!str || fwrite(str, 1, len, f) == len));
+}
+
+static bool
+write_array(FILE *f, const char **array)
+{
+   uint32_t count = 0;
+   for (; array && array[count]; ++count);
+   count = (array ? count : NOSTRING);
+
+   if (fwrite(&count, sizeof(count), 1, f) != 1)
+      return false;
+
+   for (uint32_t i = 0; array && array[i]; ++i) {
+      if (!write_string(f, array[i]))
+         return false;
+   }
+
+   return true;
+}
+
+void
+manifest_info_release(struct plugin_info *info)
+{
+   assert(info);
+
+   free((char*)info->name);
+   free((char*)info->description);
+   free((char*)info->version);
+
+   const char ***arrays[] = INFO_ARRAYS(info);
+   for (uint32_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i) {
+      for (uint32_t s = 0; *arrays[i] && (*arrays[i])[s]; ++s)
+         free((char*)(*arrays[i])[s]);
+      free(*arrays[i]);
+   }
+
+   memset(info, 0, sizeof(struct plugin_info));
+}
+
+static char*
+copy_cstr(const char *str, bool *ok)
+{
+   char *copy = NULL;
+   if (str && !(copy = strdup(str)))
+      *ok = false;
+   return copy;
+}
+
+bool
+manifest_info_copy(struct plugin_info *dst, const struct plugin_info *src)
+{
+   assert(dst && src);
+   memset(dst, 0, sizeof(struct plugin_info));
+
+   bool ok = true;
+   dst->name = copy_cstr(src->name, &ok);
+   dst->description = copy_cstr(src->description, &ok);
+   dst->version = copy_cstr(src->version, &ok);
+   dst->lazy = src->lazy;
+   dst->parallel_init = src->parallel_init;
+
+   const char ***to[] = INFO_ARRAYS(dst);
+   const char **const *from[] = INFO_ARRAYS(src);
+   for (uint32_t i = 0; ok && i < sizeof(to) / sizeof(to[0]); ++i) {
+      if (!*from[i])
+         continue;
+
+      uint32_t count = 0;
+      for (; (*from[i])[count]; ++count);
+
+      char **array;
+      if (!(array = chck_calloc_of(count + 1, sizeof(char*)))) {
+         ok = false;
+         break;
+      }
+
+      *to[i] = (const char**)array;
+      for (uint32_t s = 0; ok && s < count; ++s)
+         array[s] = copy_cstr((*from[i])[s], &ok);
+   }
+
+   if (!ok)
+      manifest_info_release(dst);
+
+   return ok;
+}
+
+static void
+entry_release(struct manifest_entry *entry)
+{
+   if (!entry)
+      return;
+
+   chck_string_release(&entry->path);
+   manifest_info_release(&entry->info);
+}
+
+static bool
+read_entry(struct reader *r, struct manifest_entry *out_entry)
+{
+   assert(r && out_entry);
+   memset(out_entry, 0, sizeof(struct manifest_entry));
+
+   char *path;
+   if (!read_string(r, &path) || !path)
+      return false;
+
+   out_entry->path = (struct chck_string){ .data = path, .size = strlen(path), .is_heap = true };
+
+   char *strings[3] = {0};
+   const bool ok = (read_bytes(r, &out_entry->mtime_sec, sizeof(out_entry->mtime_sec)) &&
+                    read_bytes(r, &out_entry->mtime_nsec, sizeof(out_entry->mtime_nsec)) &&
+                    read_bytes(r, &out_entry->size, sizeof(out_entry->size)) &&
+                    read_string(r, &strings[0]) && read_string(r, &strings[1]) && read_string(r, &strings[2]));
+
+   out_entry->info.name = strings[0];
+   out_entry->info.description = strings[1];
+   out_entry->info.version = strings[2];
+
+   if (!ok || !out_entry->info.name)
+      return false;
+
+   const char ***arrays[] = INFO_ARRAYS(&out_entry->info);
+   for (uint32_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i) {
+      if (!read_array(r, arrays[i]))
+         return false;
+   }
+
+   uint8_t flags;
+   if (!read_bytes(r, &flags, sizeof(flags)))
+      return false;
+
+   out_entry->info.lazy = (flags & FLAG_LAZY);
+   out_entry->info.parallel_init = (flags & FLAG_PARALLEL_INIT);
+   return true;
+}
+
+static bool
+write_entry(FILE *f, const struct manifest_entry *entry)
+{
+   assert(f && entry);
+
+   if (!write_string(f, entry->path.data) ||
+       fwrite(&entry->mtime_sec, sizeof(entry->mtime_sec), 1, f) != 1 ||
+       fwrite(&entry->mtime_nsec, sizeof(entry->mtime_nsec), 1, f) != 1 ||
+       fwrite(&entry->size, sizeof(entry->size), 1, f) != 1 ||
+       !write_string(f, entry->info.name) ||
+       !write_string(f, entry->info.description) ||
+       !write_string(f, entry->info.version))
+      return false;
+
+   const char **const *arrays[] = INFO_ARRAYS(&entry->info);
+   for (uint32_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i) {
+      if (!write_array(f, *arrays[i]))
+         return false;
+   }
+
+   const uint8_t flags = (entry->info.lazy ? FLAG_LAZY : 0) | (entry->info.parallel_init ? FLAG_PARALLEL_INIT : 0);
+   return (fwrite(&flags, sizeof(flags), 1, f) == 1);
+}
+
+static bool
+add_entry(struct manifest *manifest, struct manifest_entry *entry)
+{
+   assert(manifest && entry);
+
+   const size_t index = manifest->entries.items.count;
+   if (!chck_iter_pool_push_back(&manifest->entries, entry))
+      return false;
+
+   // on failure the pooled copy is dropped, so entry stays owned by the caller
+   if (!chck_hash_table_str_set(&manifest->paths, entry->path.data, entry->path.size, &index)) {
+      chck_iter_pool_remove(&manifest->entries, index);
+      return false;
+   }
+
+   return true;
+}
+
+bool
+manifest_load(struct manifest *manifest)
+{
+   assert(manifest);
+   memset(manifest, 0, sizeof(struct manifest));
+
+   if (!chck_iter_pool(&manifest->entries, 16, 0, sizeof(struct manifest_entry)) ||
+       !chck_hash_table(&manifest->paths, 0, 64, sizeof(size_t)))
+      return false;
+
+   struct chck_string path = {0};
+   if (!get_path(&path, false))
+      goto out;
+
+   FILE *f;
+   if (!(f = fopen(path.data, "rb")))
+      goto out;
+
+   uint8_t *data = NULL;
+   long size;
+   if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) != 0 ||
+       !(data = malloc(size)) || fread(data, 1, size, f) != (size_t)size) {
+      free(data);
+      fclose(f);
+      goto out;
+   }
+
+   fclose(f);
+
+   // Any damage throws the whole cache away, it is rebuilt on save
+   struct reader r = { data, data + size };
+   char magic[sizeof(MANIFEST_MAGIC)];
+   if (read_bytes(&r, magic, sizeof(magic)) && !memcmp(magic, MANIFEST_MAGIC, sizeof(magic))) {
+      while (r.data < r.end) {
+         struct manifest_entry entry;
+         if (!read_entry(&r, &entry) || !add_entry(manifest, &entry)) {
+            entry_release(&entry);
+            plog(0, PLOG_WARN, "Plugin manifest cache %s is damaged, rebuilding it", path.data);
+            chck_iter_pool_for_each_call(&manifest->entries, entry_release);
+            chck_iter_pool_empty(&manifest->entries);
+            chck_hash_table_release(&manifest->paths);
+            chck_hash_table(&manifest->paths, 0, 64, sizeof(size_t));
+            manifest->dirty = true;
+            break;
+         }
+      }
+   }
+
+   free(data);
+
+out:
+   chck_string_release(&path);
+   return true;
+}
+
+bool
+manifest_save(struct manifest *manifest)
+{
+   assert(manifest);
+
+   // entries of plugins that were not seen are gone
+   const struct manifest_entry *e;
+   chck_iter_pool_for_each(&manifest->entries, e)
+      manifest->dirty = (manifest->dirty || !e->used);
+
+   if (!manifest->dirty)
+      return true;
+
+   struct chck_string path = {0}, tmp = {0};
+   if (!get_path(&path, true) || !chck_string_set_format(&tmp, "%s.%d", path.data, (int)getpid()))
+      goto error0;
+
+   // written beside and renamed over, so concurrent readers never see partial file
+   FILE *f;
+   if (!(f = fopen(tmp.data, "wb")))
+      goto error0;
+
+   bool ok = (fwrite(MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC), 1, f) == 1);
+   chck_iter_pool_for_each(&manifest->entries, e) {
+      if (ok && e->used)
+         ok = write_entry(f, e);
+   }
+
+   if (fclose(f) != 0 || !ok || rename(tmp.data, path.data) != 0) {
+      unlink(tmp.data);
+      goto error0;
+   }
+
+   manifest->dirty = false;
+   chck_string_release(&path);
+   chck_string_release(&tmp);
+   return true;
+
+error0:
+   plog(0, PLOG_WARN, "Could not write plugin manifest cache %s", (path.data ? path.data : "(no path)"));
+   chck_string_release(&path);
+   chck_string_release(&tmp);
+   return false;
+}
+
+void
+manifest_release(struct manifest *manifest)
+{
+   if (!manifest)
+      return;
+
+   chck_iter_pool_for_each_call(&manifest->entries, entry_release);
+   chck_iter_pool_release(&manifest->entries);
+   chck_hash_table_release(&manifest->paths);
+}
+
+static struct manifest_entry*
+get_entry(struct manifest *manifest, const char *path)
+{
+   assert(manifest && path);
+
+   const size_t *index;
+   if (!manifest->paths.lut.table || !(index = chck_hash_table_str_get(&manifest->paths, path, strlen(path))))
+      return NULL;
+
+   struct manifest_entry *e;
+   return ((e = chck_iter_pool_get(&manifest->entries, *index)) && chck_cstreq(e->path.data, path) ? e : NULL);
+}
+
+const struct plugin_info*
+manifest_get(struct manifest *manifest, const char *path, const struct stat *st)
+{
+   assert(manifest && path && st);
+
+   struct manifest_entry *e;
+   if (!(e = get_entry(manifest, path)))
+      return NULL;
+
+   e->used = true;
+
+   if (e->mtime_sec != (int64_t)st->st_mtim.tv_sec || e->mtime_nsec != (int64_t)st->st_mtim.tv_nsec || e->size != (uint64_t)st->st_size)
+      return NULL;
+
+   return &e->info;
+}
+
+bool
+manifest_set(struct manifest *manifest, const char *path, const struct stat *st, const struct plugin_info *info)
+{
+   assert(manifest && path && st && info);
+
+   struct manifest_entry entry = {
+      .mtime_sec = st->st_mtim.tv_sec,
+      .mtime_nsec = st->st_mtim.tv_nsec,
+      .size = st->st_size,
+      .used = true,
+   };
+
+   if (!chck_string_set_cstr(&entry.path, path, true) || !manifest_info_copy(&entry.info, info))
+      goto error0;
+
+   manifest->dirty = true;
+
+   struct manifest_entry *old;
+   if ((old = get_entry(manifest, path))) {
+      entry_release(old);
+      *old = entry;
+      return true;
+   }
+
+   if (!add_entry(manifest, &entry))
+      goto error0;
+
+   return true;
+
+error0:
+   entry_release(&entry);
+   return false;
+}
@@ -0,0 +1,47 @@
+#ifndef __orbment_manifest_h__
+#define __orbment_manifest_h__
+
+#include <orbment/plugin.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <chck/pool/pool.h>
+#include <chck/lut/lut.h>
+
+/**
+ * On-disk cache of plugin_info of plugin files, keyed by path, modification time and size.
+ * Lets dependency resolution run without opening every plugin.
+ */
+
+struct manifest_entry {
+   struct chck_string path;
+   int64_t mtime_sec, mtime_nsec;
+   uint64_t size;
+   // strings and arrays are owned, methods is always NULL
+   struct plugin_info info;
+   bool used;
+};
+
+struct manifest {
+   struct chck_iter_pool entries;
+   // path -> index to entries
+   struct chck_hash_table paths;
+   bool dirty;
+};
+
+bool manifest_load(struct manifest *manifest);
+
+/** Writes manifest back if it changed, entries not used since load are dropped. */
+bool manifest_save(struct manifest *manifest);
+
+void manifest_release(struct manifest *manifest);
+
+/** Returns entry for path, if file has not changed since it was cached. */
+PNONULL const struct plugin_info* manifest_get(struct manifest *manifest, const char *path, const struct stat *st);
+
+PNONULL bool manifest_set(struct manifest *manifest, const char *path, const struct stat *st, const struct plugin_info *info);
+
+/** Deep copy of info without methods, release with manifest_info_release. */
+PNONULL bool manifest_info_copy(struct plugin_info *dst, const struct plugin_info *src);
+PNONULL void manifest_info_release(struct plugin_info *info);
+
+#endif /* __orbment_manifest_h__ */
@@ -1,14 +1,187 @@
 #include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <chck/math/math.h>
 #include <chck/xdg/xdg.h>
 #include <wlc/wlc.h>
 #include "config.h"
 #include "signals.h"
+#include "launcher.h"
 #include "plugin.h"
+#include "manifest.h"
 #include "hooks.h"
 #include "log.h"
 
+enum {
+   // dlopen serializes on the loader lock, more threads mostly just wait for disk
+   LOADER_MAX_THREADS = 4,
+};
+
+struct load_job {
+   struct plugin_object object;
+   struct chck_string path;
+   struct stat st;
+   // info from manifest, job is registered without opening
+   const struct plugin_info *cached;
+   uint64_t duration;
+};
+
+struct loader {
+   struct load_job *jobs;
+   size_t memb, next;
+   pthread_mutex_t mutex;
+};
+
+static inline uint64_t
+now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void*
+load_worker(void *arg)
+{
+   struct loader *loader = arg;
+
+   for (;;) {
+      pthread_mutex_lock(&loader->mutex);
+      const size_t i = loader->next++;
+      pthread_mutex_unlock(&loader->mutex);
+
+      if (i >= loader->memb)
+         break;
+
+      struct load_job *job = &loader->jobs[i];
+      if (job->cached)
+         continue;
+
+      const uint64_t start = now();
+      plugin_open(job->path.data, &job->object);
+      job->duration = now() - start;
+   }
+
+   return NULL;
+}
+
+static int
+name_cmp(const void *a, const void *b)
+{
+   return strcmp(((const struct chck_string*)a)->data, ((const struct chck_string*)b)->data);
+}
+
+/** Appends plugins of directory to out_paths sorted by name, readdir order is not stable. */
+static void
+find_plugins(const char *dir, struct chck_iter_pool *out_paths)
+{
+   assert(dir && out_paths);
+
+   DIR *d;
+   if (!(d = opendir(dir))) {
+      plog(0, PLOG_WARN, "Could not open plugins directory: %s", dir);
+      return;
+   }
+
+   const size_t first = out_paths->items.count;
+
+   struct dirent *dirent;
+   while ((dirent = readdir(d))) {
+      if (!chck_cstr_starts_with(dirent->d_name, "orbment-plugin-"))
+         continue;
+
+      struct chck_string tmp = {0};
+      if (!chck_string_set_format(&tmp, "%s/%s", dir, dirent->d_name) || !chck_iter_pool_push_back(out_paths, &tmp))
+         chck_string_release(&tmp);
+   }
+
+   closedir(d);
+   qsort(out_paths->items.buffer + first * out_paths->items.member, out_paths->items.count - first, out_paths->items.member, name_cmp);
+}
+
+/**
+ * Opens plugins on a small thread pool, as dlopen and symbol resolution of a dozen shared objects
+ * adds up on cold caches. Registration happens afterwards on this thread, in the order plugins were found.
+ */
+static void
+register_plugins(struct chck_iter_pool *paths)
+{
+   assert(paths);
+
+   struct loader loader = {
+      .memb = paths->items.count,
+   };
+
+   if (!loader.memb || !(loader.jobs = chck_calloc_of(loader.memb, sizeof(struct load_job))))
+      return;
+
+   struct manifest manifest;
+   const bool has_manifest = manifest_load(&manifest);
+
+   size_t misses = 0;
+   const struct chck_string *path;
+   chck_iter_pool_for_each(paths, path) {
+      struct load_job *job = &loader.jobs[_I - 1];
+      job->path = *path;
+
+      if (stat(path->data, &job->st) != 0)
+         memset(&job->st, 0, sizeof(job->st));
+
+      if (!has_manifest || !(job->cached = manifest_get(&manifest, path->data, &job->st)))
+         ++misses;
+   }
+
+   const uint64_t start = now();
+   pthread_mutex_init(&loader.mutex, NULL);
+
+   long cpus;
+   const size_t threads = chck_maxsz(chck_minsz(chck_minsz(((cpus = sysconf(_SC_NPROCESSORS_ONLN)) > 0 ? cpus : 1), LOADER_MAX_THREADS), misses), 1);
+
+   // this thread works too, if creating any of the threads fails the rest of the jobs are still done
+   size_t started = 0;
+   pthread_t workers[LOADER_MAX_THREADS];
+   for (; started + 1 < threads && pthread_create(&workers[started], NULL, load_worker, &loader) == 0; ++started);
+
+   load_worker(&loader);
+
+   for (size_t i = 0; i < started; ++i)
+      pthread_join(workers[i], NULL);
+
+   pthread_mutex_destroy(&loader.mutex);
+   plog(0, PLOG_INFO, "Opened %zu/%zu plugins with %zu threads in %.2f ms, rest from manifest", misses, loader.memb, started + 1, (now() - start) / 1e6);
+
+   for (size_t i = 0; i < loader.memb; ++i) {
+      struct load_job *job = &loader.jobs[i];
+
+      if (job->cached) {
+         plugin_register_cached(job->path.data, job->cached);
+         continue;
+      }
+
+      // cached even if registering fails, so conflicting plugins are not opened again either
+      const struct plugin_info *info;
+      if (has_manifest && job->object.reg && (info = job->object.reg()) && info->name) {
+         struct plugin_info copy;
+         plugin_info_copy(&copy, info, job->object.info_version);
+         manifest_set(&manifest, job->path.data, &job->st, &copy);
+      }
+
+      plog(0, PLOG_DEBUG, "%s: opened in %.2f ms", job->path.data, job->duration / 1e6);
+      plugin_register_object(&job->object);
+   }
+
+   if (has_manifest)
+      manifest_save(&manifest);
+
+   manifest_release(&manifest);
+   free(loader.jobs);
+}
+
 static void
 register_plugins_from_path(void)
 {
@@ -35,26 +208,15 @@ register_plugins_from_path(void)
       const char *paths[] = { xdg.data, PLUGINS_PATH, NULL };
 #endif
 
-      // FIXME: add portable directory code to chck/fs/fs.c
-      for (uint32_t i = 0; paths[i]; ++i) {
-         DIR *d;
-         if (!(d = opendir(paths[i]))) {
-            plog(0, PLOG_WARN, "Could not open plugins directory: %s", paths[i]);
-            continue;
-         }
-
-         struct dirent *dir;
-         while ((dir = readdir(d))) {
-            if (!chck_cstr_starts_with(dir->d_name, "orbment-plugin-"))
-               continue;
-
-            struct chck_string tmp = {0};
-            if (chck_string_set_format(&tmp, "%s/%s", paths[i], dir->d_name))
-               plugin_register_from_path(tmp.data);
-            chck_string_release(&tmp);
-         }
+      struct chck_iter_pool found;
+      if (chck_iter_pool(&found, 16, 0, sizeof(struct chck_string))) {
+         // FIXME: add portable directory code to chck/fs/fs.c
+         for (uint32_t i = 0; paths[i]; ++i)
+            find_plugins(paths[i], &found);
 
-         closedir(d);
+         register_plugins(&found);
+         chck_iter_pool_for_each_call(&found, chck_string_release);
+         chck_iter_pool_release(&found);
       }
 
       chck_string_release(&xdg);
@@ -67,6 +229,7 @@ setup_plugins(void)
    if (!hooks_setup())
       return false;
 
+   plugin_register_builtins();
    register_plugins_from_path();
    plugin_load_all();
    return true;
@@ -81,7 +244,15 @@ handle_arguments(int argc, char *argv[])
             plog(0, PLOG_ERROR, "--log takes an argument (filename)");
             abort();
          }
-         log_set_file(argv[++i]);
+         log_set_file(argv[++i], false);
+      } else if (chck_cstreq(argv[i], "--log-binary")) {
+         if (i + 1 >= argc) {
+            plog(0, PLOG_ERROR, "--log-binary takes an argument (filename)");
+            abort();
+         }
+         log_set_file(argv[++i], true);
+      } else if (chck_cstreq(argv[i], "--profile-hooks")) {
+         hooks_set_profiling(true);
       }
    }
 }
@@ -91,6 +262,10 @@ main(int argc, char *argv[])
 {
    (void)argc, (void)argv;
 
+   // Fork the launcher while the process is still small and single threaded
+   const bool launcher = launcher_setup();
+
+   signals_setup_crash();
    signals_setup_debug();
 
    // XXX: Potentially dangerous under suid
@@ -100,6 +275,9 @@ main(int argc, char *argv[])
    if (!wlc_init())
       return EXIT_FAILURE;
 
+   if (!launcher || !launcher_listen())
+      plog(0, PLOG_WARN, "Could not start launcher process, programs are spawned with wlc_exec");
+
    signals_setup();
 
    if (!setup_plugins())
@@ -109,6 +287,7 @@ main(int argc, char *argv[])
 
    wlc_run();
 
+   launcher_release();
    plog(0, PLOG_INFO, "-- Orbment is gone, bye bye! --");
    log_close();
    return EXIT_SUCCESS;
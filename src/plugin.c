@@ -1,18 +1,50 @@
 #include "plugin.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <chck/math/math.h>
 #include <chck/dl/dl.h>
 #include <chck/lut/lut.h>
 #include <chck/pool/pool.h>
 #include <chck/string/string.h>
 #include <chck/overflow/overflow.h>
+#include "manifest.h"
 #include "log.h"
 
 static const size_t NOTINDEX = (size_t)-1;
 
+enum {
+   // plugins with parallel_init in the same wave are initialized on this many threads at most
+   INIT_MAX_THREADS = 4,
+};
+
 static struct chck_pool plugins;
 static struct chck_hash_table names;
 static struct chck_hash_table groups;
 
+enum { DEFAULT_VERBOSITY = 2 };
+static const uint8_t NOVERBOSITY = 0xFF;
+uint8_t plog_max_verbosity = DEFAULT_VERBOSITY;
+
+static struct {
+   // plugin name -> verbosity, kept for plugins not yet registered
+   struct chck_hash_table names;
+   // verbosity of the core (plugin handle 0)
+   uint8_t core;
+} verbosity = { .core = DEFAULT_VERBOSITY };
+
+// plugin name -> enabled, kept for plugins not yet registered
+static struct chck_hash_table enabled;
+
+// result of last plugin_list_group
+static struct chck_iter_pool group_names;
+
+static struct {
+   // plugins are initializing on multiple threads, plugin tables must not change
+   bool parallel;
+} loader;
+
 static struct {
    void (*loaded)(const struct plugin *plugin);
    void (*deloaded)(const struct plugin *plugin);
@@ -150,124 +182,548 @@ deload_plugin(struct plugin *p, bool force)
    if (p->loaded && p->deinit)
       p->deinit(p->handle + 1);
 
-   if (p->dl)
+   if (p->dl) {
       chck_dl_unload(p->dl);
+      log_forget_strings();
+   }
 
    p->dl = NULL;
    p->loaded = false;
    return true;
 }
 
-static bool load_plugin(struct plugin *p);
+PPURE static bool
+belongs_to_pool(const char **pool, const char *name)
+{
+   assert(name);
+   for (uint32_t i = 0; pool && pool[i]; ++i) {
+      if (chck_cstreq(pool[i], name))
+         return true;
+   }
+   return false;
+}
+
+static struct plugin*
+get_provider(const char *name)
+{
+   assert(name);
+
+   struct plugin *p;
+   if ((p = get(name)))
+      return p;
+
+   chck_pool_for_each(&plugins, p) {
+      if (belongs_to_pool(p->info.provides, name))
+         return p;
+   }
+
+   return NULL;
+}
 
 static bool
-load_dep(struct plugin *p, struct plugin *d, bool hard)
+map_plugin(struct plugin *p)
 {
-   assert(p && d);
+   assert(p);
 
-   if (!d->loaded && !load_plugin(d) && hard)
-      return false;
+   // plugins with path need handle, or they point garbage
+   if (p->dl || !p->owns_info)
+      return (p->dl || chck_string_is_empty(&p->path));
 
-   struct chck_string name = {0};
-   if (!chck_string_set_cstr(&name, p->info.name, true))
+   // plugin tables are only read while plugins initialize in parallel
+   if (loader.parallel) {
+      plog(0, PLOG_ERROR, "Plugin '%s' can not be mapped during parallel initialization, require it instead", p->info.name);
       return false;
+   }
 
-   if (!chck_iter_pool_push_back(&d->needed, &name))
+   struct plugin_object object;
+   if (!plugin_open(p->path.data, &object)) {
+      plog(0, PLOG_ERROR, "%s", (object.error.data ? object.error.data : "Could not open plugin"));
       goto error0;
+   }
+
+   const struct plugin_info *info;
+   if (!(info = object.reg()) || !info->name || !chck_cstreq(info->name, p->info.name)) {
+      plog(0, PLOG_ERROR, "Plugin '%s' changed since it was registered: %s", p->info.name, p->path.data);
+      goto error0;
+   }
 
+   // cached copy is replaced by the real info, both hash tables were keyed by name hash only
+   manifest_info_release(&p->info);
+   log_forget_strings();
+   plugin_info_copy(&p->info, info, object.info_version);
+   p->owns_info = false;
+   p->init = object.init;
+   p->deinit = object.deinit;
+   p->dl = object.dl;
+   object.dl = NULL;
+   plugin_object_release(&object);
    return true;
 
 error0:
-   chck_string_release(&name);
+   plugin_object_release(&object);
    return false;
 }
 
 static bool
-load_deps_from_group(struct plugin *p, struct chck_iter_pool *pool, bool hard)
+is_disabled(const char *name)
 {
-   assert(p && pool);
-   plugin_h *h;
-   chck_iter_pool_for_each(pool, h) {
-      struct plugin *d = chck_pool_get(&plugins, *h);
-      if (d && !load_dep(p, d, hard))
-         return false;
-   }
-   return true;
+   assert(name);
+   const bool *e = (enabled.lut.table ? chck_hash_table_str_get(&enabled, name, strlen(name)) : NULL);
+   return (e && !*e);
 }
 
-PPURE static bool
-belongs_to_pool(const char **pool, const char *name)
+/**
+ * Dependency graph of registered plugins, indexed by plugin handle.
+ * Edges point from dependency to dependent, so Kahn's algorithm yields waves of plugins
+ * whose dependencies are all initialized.
+ */
+
+struct load_node {
+   struct plugin *plugin;
+   // edges from wanted dependencies that are not done yet
+   size_t pending;
+   bool wanted, done, failed;
+};
+
+struct load_edge {
+   size_t from, to;
+   bool hard;
+};
+
+struct load_graph {
+   struct load_node *nodes;
+   struct chck_iter_pool edges;
+   size_t memb;
+};
+
+static bool
+graph_add_edge(struct load_graph *graph, size_t from, size_t to, bool hard)
 {
-   assert(name);
-   for (uint32_t i = 0; pool && pool[i]; ++i) {
-      if (chck_cstreq(pool[i], name))
+   assert(graph);
+
+   if (from == to)
+      return true;
+
+   struct load_edge *e;
+   chck_iter_pool_for_each(&graph->edges, e) {
+      if (e->from == from && e->to == to) {
+         e->hard = (e->hard || hard);
          return true;
+      }
    }
-   return false;
+
+   return chck_iter_pool_push_back(&graph->edges, &(struct load_edge){ from, to, hard });
 }
 
 static bool
-load_deps_from_array(struct plugin *p, const char **array, bool hard)
+graph_add_deps(struct load_graph *graph, size_t node, const char **array, bool hard)
 {
-   assert(p);
+   assert(graph);
 
+   const struct plugin *p = graph->nodes[node].plugin;
    for (uint32_t i = 0; array && array[i]; ++i) {
+      // every member of a group is a dependency, unless plugin is part of the group itself
       struct chck_iter_pool *pool;
-      if (!belongs_to_pool(p->info.groups, array[i]) && (pool = get_group(array[i])))
-         return load_deps_from_group(p, pool, hard);
+      if (!belongs_to_pool(p->info.groups, array[i]) && (pool = get_group(array[i]))) {
+         plugin_h *h;
+         chck_iter_pool_for_each(pool, h) {
+            if (*h < graph->memb && graph->nodes[*h].plugin && !graph_add_edge(graph, *h, node, hard))
+               return false;
+         }
+         continue;
+      }
 
       struct plugin *d;
-      if (!(d = get(array[i])) && hard) {
-         plog(0, PLOG_ERROR, "Dependency '%s' for plugin '%s' was not found", array[i], p->info.name);
-         return false;
+      if (!(d = get_provider(array[i]))) {
+         if (hard && !graph->nodes[node].failed) {
+            plog(0, PLOG_ERROR, "Dependency '%s' for plugin '%s' was not found", array[i], p->info.name);
+            graph->nodes[node].failed = true;
+         }
+         continue;
       }
 
-      if (d && (belongs_to_pool(d->info.requires, p->info.name) || belongs_to_pool(d->info.after, p->info.name))) {
-         plog(0, PLOG_ERROR, "Circular dependency detected for plugins '%s' and '%s'", p->info.name, d->info.name);
+      if (!graph_add_edge(graph, d->handle, node, hard))
          return false;
+   }
+
+   return true;
+}
+
+static void
+graph_release(struct load_graph *graph)
+{
+   assert(graph);
+   free(graph->nodes);
+   chck_iter_pool_release(&graph->edges);
+}
+
+static bool
+graph_build(struct load_graph *graph)
+{
+   assert(graph);
+   memset(graph, 0, sizeof(struct load_graph));
+
+   struct plugin *p;
+   chck_pool_for_each(&plugins, p)
+      graph->memb = chck_maxsz(graph->memb, _I);
+
+   if (!chck_iter_pool(&graph->edges, 32, 0, sizeof(struct load_edge)) ||
+       !(graph->nodes = chck_calloc_of(chck_maxsz(graph->memb, 1), sizeof(struct load_node))))
+      goto error0;
+
+   chck_pool_for_each(&plugins, p)
+      graph->nodes[_I - 1].plugin = p;
+
+   for (size_t i = 0; i < graph->memb; ++i) {
+      if (!(p = graph->nodes[i].plugin) || p->loaded)
+         continue;
+
+      if (!graph_add_deps(graph, i, p->info.requires, true) ||
+          !graph_add_deps(graph, i, p->info.after, false))
+         goto error0;
+   }
+
+   return true;
+
+error0:
+   graph_release(graph);
+   return false;
+}
+
+static void
+graph_want(struct load_graph *graph, const plugin_h *roots, size_t memb)
+{
+   assert(graph);
+
+   for (size_t i = 0; i < graph->memb; ++i) {
+      const struct plugin *p = graph->nodes[i].plugin;
+      graph->nodes[i].wanted = (p && !p->loaded && !roots && !p->info.lazy);
+   }
+
+   for (size_t i = 0; roots && i < memb; ++i) {
+      if (roots[i] < graph->memb && graph->nodes[roots[i]].plugin)
+         graph->nodes[roots[i]].wanted = !graph->nodes[roots[i]].plugin->loaded;
+   }
+
+   // required dependencies of wanted plugins are wanted, groups in requires included.
+   // after only orders plugins that are wanted anyway, so it never loads a lazy plugin.
+   bool changed;
+   do {
+      changed = false;
+      struct load_edge *e;
+      chck_iter_pool_for_each(&graph->edges, e) {
+         struct load_node *from = &graph->nodes[e->from];
+         if (!e->hard || !graph->nodes[e->to].wanted || from->wanted || from->plugin->loaded)
+            continue;
+
+         from->wanted = changed = true;
       }
+   } while (changed);
 
-      if (d && !load_dep(p, d, hard))
-         return false;
+   struct load_edge *e;
+   chck_iter_pool_for_each(&graph->edges, e) {
+      if (graph->nodes[e->from].wanted && graph->nodes[e->to].wanted)
+         graph->nodes[e->to].pending++;
    }
+}
+
+static bool
+needed_by(struct plugin *d, struct plugin *p)
+{
+   assert(d && p);
+
+   struct chck_string name = {0};
+   if (!chck_string_set_cstr(&name, p->info.name, true))
+      return false;
+
+   if (!chck_iter_pool_push_back(&d->needed, &name))
+      goto error0;
 
    return true;
+
+error0:
+   chck_string_release(&name);
+   return false;
 }
 
 static bool
-load_plugin(struct plugin *p)
+prepare_node(struct load_graph *graph, size_t node)
 {
-   assert(p);
+   assert(graph);
 
-   // plugins with path need handle, or they point garbage
-   if (!chck_string_is_empty(&p->path) && !p->dl)
+   struct plugin *p = graph->nodes[node].plugin;
+
+   // disabled plugins are never mapped, and neither are the ones requiring them
+   if (is_disabled(p->info.name)) {
+      plog(0, PLOG_INFO, "Plugin '%s' is disabled", p->info.name);
       return false;
+   }
 
-   if (p->loaded)
-      return true;
+   if (graph->nodes[node].failed)
+      return false;
 
-   if (!load_deps_from_array(p, p->info.requires, true))
-      goto error0;
+   struct load_edge *e;
+   chck_iter_pool_for_each(&graph->edges, e) {
+      if (e->to != node || !e->hard || graph->nodes[e->from].plugin->loaded)
+         continue;
+
+      plog(0, PLOG_ERROR, "Dependency '%s' for plugin '%s' failed to load", graph->nodes[e->from].plugin->info.name, p->info.name);
+      return false;
+   }
+
+   // dependencies are resolved from cached info, so only plugins that will load get mapped
+   return map_plugin(p);
+}
+
+static void
+release_dependents(struct load_graph *graph, size_t node)
+{
+   assert(graph);
+
+   graph->nodes[node].done = true;
+
+   struct load_edge *e;
+   chck_iter_pool_for_each(&graph->edges, e) {
+      if (e->from == node && graph->nodes[e->to].wanted)
+         graph->nodes[e->to].pending--;
+   }
+}
+
+static void
+finish_node(struct load_graph *graph, size_t node, bool initialized)
+{
+   assert(graph);
+
+   struct plugin *p = graph->nodes[node].plugin;
 
-   // optional deps
-   load_deps_from_array(p, p->info.after, false);
+   if (initialized) {
+      struct load_edge *e;
+      chck_iter_pool_for_each(&graph->edges, e) {
+         if (e->to == node && graph->nodes[e->from].plugin->loaded)
+            needed_by(graph->nodes[e->from].plugin, p);
+      }
 
-   p->loaded = true;
+      if (callbacks.loaded)
+         callbacks.loaded(p);
+   } else {
+      plog(0, PLOG_INFO, "Plugin '%s' failed to load", p->info.name);
+      deload_plugin(p, false);
+   }
 
+   release_dependents(graph, node);
+}
+
+static bool
+init_plugin(struct plugin *p)
+{
+   assert(p);
    plog(0, PLOG_INFO, "Loading plugin '%s'", p->info.name);
+   return (!p->init || p->init(p->handle + 1));
+}
 
-   if (p->init && !p->init(p->handle + 1))
-      goto error0;
+struct init_job {
+   struct plugin *plugin;
+   bool initialized;
+};
+
+struct init_queue {
+   struct init_job *jobs;
+   size_t memb, next;
+   pthread_mutex_t mutex;
+};
+
+static void*
+init_worker(void *arg)
+{
+   struct init_queue *queue = arg;
+
+   for (;;) {
+      pthread_mutex_lock(&queue->mutex);
+      const size_t i = queue->next++;
+      pthread_mutex_unlock(&queue->mutex);
+
+      if (i >= queue->memb)
+         break;
+
+      queue->jobs[i].initialized = init_plugin(queue->jobs[i].plugin);
+   }
+
+   return NULL;
+}
+
+static void
+init_parallel(struct init_job *jobs, size_t memb)
+{
+   assert(jobs || !memb);
+
+   struct init_queue queue = {
+      .jobs = jobs,
+      .memb = memb,
+   };
+
+   pthread_mutex_init(&queue.mutex, NULL);
+   loader.parallel = true;
+
+   long cpus;
+   const size_t threads = chck_minsz(chck_minsz(((cpus = sysconf(_SC_NPROCESSORS_ONLN)) > 0 ? cpus : 1), INIT_MAX_THREADS), memb);
+
+   // this thread works too
+   size_t started = 0;
+   pthread_t workers[INIT_MAX_THREADS];
+   for (; started + 1 < threads && pthread_create(&workers[started], NULL, init_worker, &queue) == 0; ++started);
+
+   init_worker(&queue);
+
+   for (size_t i = 0; i < started; ++i)
+      pthread_join(workers[i], NULL);
+
+   loader.parallel = false;
+   pthread_mutex_destroy(&queue.mutex);
+}
+
+static bool
+run_wave(struct load_graph *graph, const size_t *wave, size_t memb)
+{
+   assert(graph && wave);
+
+   struct init_job *jobs;
+   if (!(jobs = chck_calloc_of(memb, sizeof(struct init_job))))
+      return false;
+
+   // plugins are marked loaded before init, so imports from init see them
+   size_t parallel = 0;
+   for (size_t i = 0; i < memb; ++i) {
+      struct plugin *p = graph->nodes[wave[i]].plugin;
+
+      // lazy import from init of an earlier plugin loaded this one already
+      if (p->loaded) {
+         release_dependents(graph, wave[i]);
+         continue;
+      }
+
+      if (!prepare_node(graph, wave[i])) {
+         finish_node(graph, wave[i], false);
+         continue;
+      }
+
+      p->loaded = true;
+
+      if (p->info.parallel_init && p->init) {
+         jobs[parallel++].plugin = p;
+      } else {
+         finish_node(graph, wave[i], init_plugin(p));
+      }
+   }
 
-   if (callbacks.loaded)
-      callbacks.loaded(p);
+   if (parallel > 1) {
+      init_parallel(jobs, parallel);
+   } else if (parallel == 1) {
+      jobs[0].initialized = init_plugin(jobs[0].plugin);
+   }
+
+   // loaded callbacks and failures are handled in this thread, in the wave order
+   for (size_t i = 0; i < parallel; ++i)
+      finish_node(graph, jobs[i].plugin->handle, jobs[i].initialized);
 
+   free(jobs);
    return true;
+}
 
-error0:
-   plog(0, PLOG_INFO, "Plugin '%s' failed to load", p->info.name);
-   deload_plugin(p, false);
-   return false;
+static void
+report_cycles(struct load_graph *graph)
+{
+   assert(graph);
+
+   // peel plugins that only depend on a cycle, whatever is left is part of one
+   bool changed;
+   do {
+      changed = false;
+      for (size_t i = 0; i < graph->memb; ++i) {
+         struct load_node *n = &graph->nodes[i];
+         if (!n->wanted || n->done)
+            continue;
+
+         bool sink = true;
+         struct load_edge *e;
+         chck_iter_pool_for_each(&graph->edges, e) {
+            if (e->from == i && graph->nodes[e->to].wanted && !graph->nodes[e->to].done) {
+               sink = false;
+               break;
+            }
+         }
+
+         if (!sink)
+            continue;
+
+         plog(0, PLOG_ERROR, "Plugin '%s' depends on circular dependency", n->plugin->info.name);
+         n->done = changed = true;
+      }
+   } while (changed);
+
+   for (size_t i = 0; i < graph->memb; ++i) {
+      struct load_node *n = &graph->nodes[i];
+      if (!n->wanted || n->done)
+         continue;
+
+      plog(0, PLOG_ERROR, "Circular dependency detected for plugin '%s'", n->plugin->info.name);
+      n->done = true;
+   }
+}
+
+/**
+ * Loads roots and their dependencies, all plugins that are not lazy if roots is NULL.
+ * Returns number of waves, dependency chain was this long.
+ */
+static size_t
+load_plugins(const plugin_h *roots, size_t memb)
+{
+   struct load_graph graph;
+   if (!graph_build(&graph))
+      return 0;
+
+   graph_want(&graph, roots, memb);
+
+   size_t *wave;
+   if (!(wave = chck_calloc_of(chck_maxsz(graph.memb, 1), sizeof(size_t)))) {
+      graph_release(&graph);
+      return 0;
+   }
+
+   size_t waves = 0;
+   for (;;) {
+      size_t count = 0;
+      for (size_t i = 0; i < graph.memb; ++i) {
+         if (graph.nodes[i].wanted && !graph.nodes[i].done && !graph.nodes[i].pending)
+            wave[count++] = i;
+      }
+
+      if (!count || !run_wave(&graph, wave, count))
+         break;
+
+      ++waves;
+   }
+
+   report_cycles(&graph);
+   free(wave);
+   graph_release(&graph);
+   return waves;
+}
+
+static bool
+load_plugin(struct plugin *p)
+{
+   assert(p);
+
+   if (p->loaded)
+      return true;
+
+   if (loader.parallel) {
+      plog(0, PLOG_ERROR, "Plugin '%s' can not be loaded during parallel initialization, require it instead", p->info.name);
+      return false;
+   }
+
+   load_plugins(&p->handle, 1);
+   return p->loaded;
 }
 
 static void
@@ -276,6 +732,11 @@ plugin_release(struct plugin *p)
    assert(p);
    deload_plugin(p, true);
    chck_string_release(&p->path);
+
+   if (p->owns_info) {
+      manifest_info_release(&p->info);
+      log_forget_strings();
+   }
 }
 
 static inline void
@@ -283,15 +744,116 @@ pvlog(plugin_h caller, enum plugin_log_type type, const char *fmt, va_list ap)
 {
    struct plugin *c;
    if (!(c = (caller ? chck_pool_get(&plugins, caller - 1) : NULL))) {
-      logv(type, NULL, fmt, ap);
+      if (plog_verbosity(type) <= verbosity.core)
+         logv(type, NULL, fmt, ap);
       return;
    }
 
-   logv(type, c->info.name, fmt, ap);
+   if (plog_verbosity(type) <= c->log_verbosity)
+      logv(type, c->info.name, fmt, ap);
+}
+
+static uint8_t
+verbosity_for_name(const char *name)
+{
+   assert(name);
+   const uint8_t *v = (verbosity.names.lut.table ? chck_hash_table_str_get(&verbosity.names, name, strlen(name)) : NULL);
+   return (v && *v != NOVERBOSITY ? *v : DEFAULT_VERBOSITY);
+}
+
+static void
+update_max_verbosity(void)
+{
+   uint8_t max = verbosity.core;
+
+   struct plugin *p;
+   chck_pool_for_each(&plugins, p)
+      max = (p->log_verbosity > max ? p->log_verbosity : max);
+
+   plog_max_verbosity = max;
+}
+
+bool
+plugin_set_log_level(const char *name, const char *level)
+{
+   assert(name && level);
+
+   static const char *levels[] = { "error", "warn", "info", "debug", "trace" };
+
+   uint8_t v = NOVERBOSITY;
+   for (uint8_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+      if (chck_cstreq(level, levels[i]))
+         v = i;
+   }
+
+   if (v == NOVERBOSITY) {
+      plog(0, PLOG_WARN, "Unknown log level '%s' for '%s'", level, name);
+      return false;
+   }
+
+   if (!verbosity.names.lut.table && !chck_hash_table(&verbosity.names, NOVERBOSITY, 32, sizeof(uint8_t)))
+      return false;
+
+   if (!chck_hash_table_str_set(&verbosity.names, name, strlen(name), &v))
+      return false;
+
+   struct plugin *p;
+   if ((p = get(name)))
+      p->log_verbosity = v;
+
+   if (chck_cstreq(name, "orbment"))
+      verbosity.core = v;
+
+   update_max_verbosity();
+   return true;
+}
+
+bool
+plugin_set_enabled(const char *name, bool enable)
+{
+   assert(name);
+
+   if (!enabled.lut.table && !chck_hash_table(&enabled, 0, 32, sizeof(bool)))
+      return false;
+
+   struct plugin *p;
+   if (!enable && (p = get(name)) && p->loaded)
+      plog(0, PLOG_WARN, "Plugin '%s' is already loaded, it will be disabled on next start", name);
+
+   return chck_hash_table_str_set(&enabled, name, strlen(name), &enable);
+}
+
+const char**
+plugin_list_group(const char *name, size_t *out_memb)
+{
+   assert(name && out_memb);
+
+   *out_memb = 0;
+
+   struct chck_iter_pool *pool;
+   if (!(pool = get_group(name)))
+      return NULL;
+
+   if (!group_names.items.member && !chck_iter_pool(&group_names, 4, 0, sizeof(const char*)))
+      return NULL;
+
+   chck_iter_pool_flush(&group_names);
+
+   plugin_h *h;
+   chck_iter_pool_for_each(pool, h) {
+      const struct plugin *p;
+      if (!(p = chck_pool_get(&plugins, *h)) || is_disabled(p->info.name))
+         continue;
+
+      if (!chck_iter_pool_push_back(&group_names, &p->info.name))
+         return NULL;
+   }
+
+   return chck_iter_pool_to_c_array(&group_names, out_memb);
 }
 
 void
-plog(plugin_h caller, enum plugin_log_type type, const char *fmt, ...)
+(plog)(plugin_h caller, enum plugin_log_type type, const char *fmt, ...)
 {
    va_list args;
    va_start(args, fmt);
@@ -315,23 +877,43 @@ plugin_remove_all(void)
 
    chck_pool_release(&plugins);
    chck_hash_table_release(&names);
+   chck_hash_table_release(&verbosity.names);
+   chck_hash_table_release(&enabled);
+   chck_iter_pool_release(&group_names);
    plog(0, PLOG_INFO, "Deloaded plugins");
 }
 
 void
 plugin_load_all(void)
 {
+   // configuration is loaded first, so it can disable the rest
+   struct chck_iter_pool *pool;
+   if ((pool = get_group("configuration"))) {
+      size_t memb;
+      const plugin_h *roots = chck_iter_pool_to_c_array(pool, &memb);
+      load_plugins(roots, memb);
+   }
+
+   const size_t waves = load_plugins(NULL, 0);
+
    struct plugin *p;
-   size_t loaded = 0, count = plugins.items.count;
+   size_t loaded = 0, lazy = 0, count = plugins.items.count;
    chck_pool_for_each(&plugins, p) {
-      if (!load_plugin(p)) {
-         chck_pool_remove(&plugins, _I - 1);
+      if (p->loaded) {
+         ++loaded;
+         continue;
+      }
+
+      if (p->info.lazy) {
+         ++lazy;
          continue;
       }
-      ++loaded;
+
+      plugin_release(p);
+      chck_pool_remove(&plugins, _I - 1);
    }
 
-   plog(0, PLOG_INFO, "Loaded %zu/%zu plugins", loaded, count);
+   plog(0, PLOG_INFO, "Loaded %zu/%zu plugins in %zu waves, %zu lazy", loaded, count, waves, lazy);
 }
 
 enum conflict_msg {
@@ -364,33 +946,49 @@ exists_in_info_array(const char *name, const char **array, bool check_group, enu
    return false;
 }
 
+static bool
+validate_info(const struct plugin_info *info)
+{
+   assert(info);
+
+   if (!info->name || !info->description) {
+      plog(0, PLOG_ERROR, "Plugin with no name or description is not allowed");
+      return false;
+   }
+
+   struct plugin *p;
+   if ((p = get(info->name))) {
+      plog(0, PLOG_ERROR, "Plugin with name '%s' is already registered", info->name);
+      return false;
+   }
+
+   return !(exists_in_info_array(info->name, info->provides, true, registered) ||
+            exists_in_info_array(info->name, info->conflicts, true, conflict) ||
+            exists_in_info_array(info->name, info->groups, false, group));
+}
+
+void
+plugin_info_copy(struct plugin_info *out_info, const struct plugin_info *info, uint32_t version)
+{
+   assert(out_info && info);
+
+   // static info of older plugins is shorter, reading all of it would run past the object
+   const size_t size = (version >= 2 ? sizeof(struct plugin_info) : offsetof(struct plugin_info, lazy));
+   memset(out_info, 0, sizeof(struct plugin_info));
+   memcpy(out_info, info, size);
+}
+
 bool
-plugin_register(struct plugin *plugin, const struct plugin_info* (*reg)(void))
+plugin_register(struct plugin *plugin, const struct plugin_info* (*reg)(void), uint32_t info_version)
 {
    assert(plugin);
 
    if (reg) {
       const struct plugin_info *info;
-      if (!(info = reg()))
+      if (!(info = reg()) || !validate_info(info))
          goto error0;
 
-      if (!info->name || !info->description) {
-         plog(0, PLOG_ERROR, "Plugin with no name or description is not allowed");
-         goto error0;
-      }
-
-      struct plugin *p;
-      if ((p = get(info->name))) {
-         plog(0, PLOG_ERROR, "Plugin with name '%s' is already registered", info->name);
-         goto error0;
-      }
-
-      if (exists_in_info_array(info->name, info->provides, true, registered) ||
-          exists_in_info_array(info->name, info->conflicts, true, conflict) ||
-          exists_in_info_array(info->name, info->groups, false, group))
-         goto error0;
-
-      memcpy(&plugin->info, info, sizeof(plugin->info));
+      plugin_info_copy(&plugin->info, info, info_version);
    }
 
    if (!plugins.items.member && !chck_pool(&plugins, 1, 0, sizeof(struct plugin)))
@@ -401,6 +999,8 @@ plugin_register(struct plugin *plugin, const struct plugin_info* (*reg)(void))
       goto error0;
 
    plugin->handle = handle;
+   plugin->log_verbosity = verbosity_for_name(plugin->info.name);
+   update_max_verbosity();
 
    if (!link_name(plugin->info.name, handle))
       goto error1;
@@ -426,35 +1026,134 @@ error0:
    return false;
 }
 
+void
+plugin_object_release(struct plugin_object *object)
+{
+   assert(object);
+
+   if (object->dl)
+      chck_dl_unload(object->dl);
+
+   chck_string_release(&object->path);
+   chck_string_release(&object->error);
+   memset(object, 0, sizeof(struct plugin_object));
+}
+
 bool
-plugin_register_from_path(const char *path)
+plugin_open(const char *path, struct plugin_object *out_object)
 {
-   assert(path);
+   assert(path && out_object);
+   memset(out_object, 0, sizeof(struct plugin_object));
 
-   void *dl;
+   if (!chck_string_set_cstr(&out_object->path, path, true))
+      return false;
+
+   // error strings of dlerror do not outlive the thread, so they are copied
    const char *error;
-   if (!(dl = chck_dl_load(path, &error))) {
-      plog(0, PLOG_ERROR, "%s", error);
+   if (!(out_object->dl = chck_dl_load(path, &error))) {
+      chck_string_set_cstr(&out_object->error, error, true);
       return false;
    }
 
    void *methods[3];
    const void *functions[3] = { "plugin_register", "plugin_init", "plugin_deinit" };
    for (int32_t i = 0; i < 3; ++i)
-      methods[i] = chck_dl_load_symbol(dl, functions[i], NULL);
+      methods[i] = chck_dl_load_symbol(out_object->dl, functions[i], NULL);
 
    if (!methods[0]) {
-      plog(0, PLOG_ERROR, "Could not find 'plugin_register' function from: %s", path);
-      chck_dl_unload(dl);
+      chck_string_set_format(&out_object->error, "Could not find 'plugin_register' function from: %s", path);
+      chck_dl_unload(out_object->dl);
+      out_object->dl = NULL;
+      return false;
+   }
+
+   out_object->reg = methods[0];
+   out_object->init = methods[1];
+   out_object->deinit = methods[2];
+
+   // plugins built before the version was exported have the first version of plugin_info
+   const uint32_t *version = chck_dl_load_symbol(out_object->dl, "plugin_info_version", NULL);
+   out_object->info_version = (version ? *version : 1);
+   return true;
+}
+
+bool
+plugin_register_object(struct plugin_object *object)
+{
+   assert(object);
+
+   if (!object->dl) {
+      plog(0, PLOG_ERROR, "%s", (object->error.data ? object->error.data : "Could not open plugin"));
+      plugin_object_release(object);
       return false;
    }
 
    struct plugin p;
    memset(&p, 0, sizeof(p));
-   p.init = methods[1];
-   p.deinit = methods[2];
-   p.dl = dl;
-   return (chck_string_set_cstr(&p.path, path, true) && plugin_register(&p, methods[0]));
+   p.init = object->init;
+   p.deinit = object->deinit;
+   p.dl = object->dl;
+   p.path = object->path;
+
+   // ownership of dl and path moves to plugin, released with it on failure
+   const struct plugin_info* (*reg)(void) = object->reg;
+   const uint32_t info_version = object->info_version;
+   object->dl = NULL;
+   memset(&object->path, 0, sizeof(object->path));
+   plugin_object_release(object);
+   return plugin_register(&p, reg, info_version);
+}
+
+bool
+plugin_register_cached(const char *path, const struct plugin_info *info)
+{
+   assert(path && info);
+
+   struct plugin p;
+   memset(&p, 0, sizeof(p));
+
+   if (!chck_string_set_cstr(&p.path, path, true) || !manifest_info_copy(&p.info, info))
+      goto error0;
+
+   p.owns_info = true;
+
+   if (!validate_info(&p.info))
+      goto error0;
+
+   return plugin_register(&p, NULL, PLUGIN_INFO_VERSION);
+
+error0:
+   plugin_release(&p);
+   return false;
+}
+
+bool
+plugin_register_from_path(const char *path)
+{
+   assert(path);
+
+   struct plugin_object object;
+   plugin_open(path, &object);
+   return plugin_register_object(&object);
+}
+
+void
+plugin_register_builtins(void)
+{
+   for (const struct plugin_builtin *b = plugin_builtins; b->reg; ++b) {
+      struct plugin p;
+      memset(&p, 0, sizeof(p));
+      p.init = b->init;
+      p.deinit = b->deinit;
+      plugin_register(&p, b->reg, PLUGIN_INFO_VERSION);
+   }
+}
+
+const char*
+plugin_name_for_handle(plugin_h handle)
+{
+   const struct plugin *p = (handle ? chck_pool_get(&plugins, handle - 1) : NULL);
+   return (p ? p->info.name : NULL);
 }
 
 plugin_h
@@ -466,7 +1165,16 @@ import_plugin(plugin_h caller, const char *name)
       return 0;
 
    const plugin_h h = get_handle(name);
-   return (h == NOTINDEX ? 0 : h + 1);
+
+   struct plugin *p;
+   if (!(p = chck_pool_get(&plugins, h)) || is_disabled(p->info.name))
+      return 0;
+
+   // lazy plugins are loaded on first import
+   if (p->info.lazy && !p->loaded && !load_plugin(p))
+      return 0;
+
+   return h + 1;
 }
 
 bool
@@ -477,17 +1185,17 @@ has_methods(plugin_h caller, plugin_h handle, const struct method_info *methods)
 
    struct plugin *c, *p;
    if (!(c = chck_pool_get(&plugins, caller - 1)) ||
-       !(p = chck_pool_get(&plugins, handle - 1)))
+       !(p = chck_pool_get(&plugins, handle - 1)) || !map_plugin(p))
       return false;
 
    for (size_t x = 0; methods[x].name; ++x) {
       bool found = false;
       for (uint32_t i = 0; p->info.methods[i].info.name && p->info.methods[i].info.signature; ++i) {
          const struct method *m = &p->info.methods[i];
-         if (!chck_cstreq(m->info.name, methods[x].name))
+         if (!chck_cstreq(m->info.name, methods[x].name) || !chck_cstreq(m->info.signature, methods[x].signature))
             continue;
 
-         found = chck_cstreq(m->info.signature, methods[x].signature);
+         found = true;
          break;
       }
 
@@ -508,17 +1216,19 @@ import_method(plugin_h caller, plugin_h handle, const char *name, const char *si
 
    struct plugin *c, *p;
    if (!(c = chck_pool_get(&plugins, caller - 1)) ||
-       !(p = chck_pool_get(&plugins, handle - 1)))
+       !(p = chck_pool_get(&plugins, handle - 1)) || !map_plugin(p))
       return false;
 
+   // Same method may be exported with multiple signatures
+   const struct method *mismatch = NULL;
    for (uint32_t i = 0; p->info.methods[i].info.name && p->info.methods[i].info.signature; ++i) {
       const struct method *m = &p->info.methods[i];
       if (!chck_cstreq(m->info.name, name))
          continue;
 
       if (!chck_cstreq(m->info.signature, signature)) {
-         plog(0, PLOG_WARN, "%s: Method '%s' '%s' != '%s' signature mismatch in %s (%s)", c->info.name, name, signature, m->info.signature, p->info.name, p->info.version);
-         return NULL;
+         mismatch = m;
+         continue;
       }
 
       if (m->deprecated)
@@ -527,6 +1237,11 @@ import_method(plugin_h caller, plugin_h handle, const char *name, const char *si
       return m->function;
    }
 
+   if (mismatch) {
+      plog(0, PLOG_WARN, "%s: Method '%s' '%s' != '%s' signature mismatch in %s (%s)", c->info.name, name, signature, mismatch->info.signature, p->info.name, p->info.version);
+      return NULL;
+   }
+
    plog(0, PLOG_WARN, "%s: No such method '%s' in %s (%s)", c->info.name, name, p->info.name, p->info.version);
    return NULL;
 }
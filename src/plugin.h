@@ -14,13 +14,66 @@ struct plugin {
    void (*deinit)(plugin_h self);
    plugin_h handle;
    void *dl;
+   uint8_t log_verbosity;
    bool loaded;
+   // info is a cached copy and dl is not opened yet
+   bool owns_info;
 };
 
+/** Shared object of a plugin, opened but not yet registered. */
+struct plugin_object {
+   struct chck_string path, error;
+   void *dl;
+   const struct plugin_info* (*reg)(void);
+   bool (*init)(plugin_h self);
+   void (*deinit)(plugin_h self);
+   // see PLUGIN_INFO_VERSION
+   uint32_t info_version;
+};
+
+/** Plugin linked into the executable, see builtin.c.in. */
+struct plugin_builtin {
+   const struct plugin_info* (*reg)(void);
+   bool (*init)(plugin_h self);
+   void (*deinit)(plugin_h self);
+};
+
+/** Zero-terminated, empty unless built with ORBMENT_STATIC_PLUGINS. */
+extern const struct plugin_builtin plugin_builtins[];
+
 void plugin_set_callbacks(void (*loaded)(const struct plugin*), void (*deloaded)(const struct plugin*));
 void plugin_remove_all(void);
 void plugin_load_all(void);
-PNONULLV(1) bool plugin_register(struct plugin *plugin, const struct plugin_info* (*reg)(void));
+PNONULLV(1) bool plugin_register(struct plugin *plugin, const struct plugin_info* (*reg)(void), uint32_t info_version);
 PNONULL bool plugin_register_from_path(const char *path);
 
+/** Registers plugin_builtins, before plugins from path so installed copies of them are rejected. */
+void plugin_register_builtins(void);
+
+/** Registers plugin from cached info, the shared object is opened only when the plugin is loaded or imported from. */
+PNONULL bool plugin_register_cached(const char *path, const struct plugin_info *info);
+
+/** Thread-safe, loads the shared object and resolves its symbols without touching the plugin tables. */
+PNONULL bool plugin_open(const char *path, struct plugin_object *out_object);
+
+/** Copies info of a plugin with given PLUGIN_INFO_VERSION, fields the plugin does not have are zeroed. */
+PNONULL void plugin_info_copy(struct plugin_info *out_info, const struct plugin_info *info, uint32_t version);
+
+/** Registers object opened with plugin_open, object is released. */
+PNONULL bool plugin_register_object(struct plugin_object *object);
+PNONULL void plugin_object_release(struct plugin_object *object);
+PNONULL bool plugin_set_log_level(const char *name, const char *level);
+
+/** Disabled plugins are not loaded, plugins may be disabled before they are registered. */
+PNONULL bool plugin_set_enabled(const char *name, bool enable);
+
+/**
+ * Names of registered plugins in group, without loading them. Disabled plugins are left out.
+ * Returned array is valid until next call.
+ */
+PNONULL const char** plugin_list_group(const char *name, size_t *out_memb);
+
+/** async-signal-safe, returns NULL for core or unknown handle. */
+PPURE const char* plugin_name_for_handle(plugin_h handle);
+
 #endif /* __orbment_plugin_private_h__ */
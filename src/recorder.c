@@ -0,0 +1,184 @@
+#include "recorder.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "hooks.h"
+#include "plugin.h"
+
+#if defined(__GLIBC__)
+#  include <execinfo.h>
+#  define HAS_BACKTRACE 1
+#endif
+
+struct entry {
+   uint64_t sequence, time, duration;
+   uintptr_t handle;
+   plugin_h owner;
+   uint8_t type;
+   bool returned;
+};
+
+static struct {
+   // written only from the main thread, where hooks are dispatched
+   struct entry entries[RECORDER_ENTRIES];
+   uint64_t next;
+   char path[256];
+} recorder;
+
+uint64_t
+recorder_begin(uint8_t hook_type, plugin_h owner, uintptr_t handle, uint64_t time)
+{
+   const uint64_t seq = ++recorder.next;
+   struct entry *e = &recorder.entries[seq & (RECORDER_ENTRIES - 1)];
+   e->sequence = seq;
+   e->time = time;
+   e->duration = 0;
+   e->handle = handle;
+   e->owner = owner;
+   e->type = hook_type;
+   e->returned = false;
+   return seq;
+}
+
+uint64_t
+recorder_end(uint64_t sequence, uint64_t time)
+{
+   struct entry *e = &recorder.entries[sequence & (RECORDER_ENTRIES - 1)];
+
+   if (e->sequence != sequence)
+      return 0;
+
+   e->returned = true;
+   return (time ? (e->duration = time - e->time) : 0);
+}
+
+void
+recorder_setup(void)
+{
+   const char *dir = getenv("XDG_RUNTIME_DIR");
+   snprintf(recorder.path, sizeof(recorder.path), "%s/orbment-crash-%d.log", (dir ? dir : "/tmp"), getpid());
+
+#if HAS_BACKTRACE
+   // first call loads libgcc, which is not safe to do from signal handler
+   void *frame;
+   backtrace(&frame, 1);
+#endif
+}
+
+static bool
+write_str(int fd, const char *str)
+{
+   assert(str);
+   return (write(fd, str, strlen(str)) >= 0);
+}
+
+static bool
+write_u64(int fd, uint64_t v)
+{
+   char buf[21];
+   size_t i = sizeof(buf);
+   do {
+      buf[--i] = '0' + v % 10;
+   } while (v /= 10);
+   return (write(fd, buf + i, sizeof(buf) - i) >= 0);
+}
+
+static const char*
+signal_name(int signal)
+{
+   switch (signal) {
+      case SIGSEGV: return "SIGSEGV";
+      case SIGABRT: return "SIGABRT";
+      case SIGBUS: return "SIGBUS";
+      case SIGILL: return "SIGILL";
+      case SIGFPE: return "SIGFPE";
+      default: break;
+   }
+
+   return "unknown";
+}
+
+static void
+write_entry(int fd, const struct entry *e, uint64_t now)
+{
+   assert(e);
+
+   const char *name = hooks_name_for_type(e->type);
+   const char *owner = plugin_name_for_handle(e->owner);
+
+   write_str(fd, "  -");
+   write_u64(fd, (now > e->time ? now - e->time : 0) / 1000);
+   write_str(fd, "us ");
+   write_str(fd, (name ? name : "unknown"));
+   write_str(fd, " plugin: ");
+   write_str(fd, (owner ? owner : "unknown"));
+   write_str(fd, " handle: ");
+   write_u64(fd, e->handle);
+
+   if (!e->returned) {
+      write_str(fd, " (did not return)\n");
+   } else if (e->duration) {
+      write_str(fd, " (returned in ");
+      write_u64(fd, e->duration / 1000);
+      write_str(fd, "us)\n");
+   } else {
+      write_str(fd, "\n");
+   }
+}
+
+static void
+write_report(int fd, int signal)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   const uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+   write_str(fd, "-- Orbment crash report --\nsignal: ");
+   write_str(fd, signal_name(signal));
+   write_str(fd, " (");
+   write_u64(fd, signal);
+   write_str(fd, ")\n\nLast hook calls, oldest first:\n");
+
+   const uint64_t first = (recorder.next > RECORDER_ENTRIES ? recorder.next - RECORDER_ENTRIES + 1 : 1);
+   for (uint64_t seq = first; seq <= recorder.next; ++seq) {
+      const struct entry *e = &recorder.entries[seq & (RECORDER_ENTRIES - 1)];
+      if (e->sequence == seq)
+         write_entry(fd, e, now);
+   }
+
+   write_str(fd, "\nBacktrace:\n");
+
+#if HAS_BACKTRACE
+   void *frames[64];
+   const int count = backtrace(frames, 64);
+   backtrace_symbols_fd(frames, count, fd);
+#else
+   write_str(fd, "  not available on this platform\n");
+#endif
+}
+
+void
+recorder_write_crash_report(int signal)
+{
+   if (!recorder.path[0])
+      return;
+
+   // The path may be in world writable /tmp, never follow or reuse a file planted there.
+   int fd;
+   if ((fd = open(recorder.path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)) < 0) {
+      write_report(STDERR_FILENO, signal);
+      return;
+   }
+
+   write_report(fd, signal);
+   close(fd);
+
+   write_str(STDERR_FILENO, "Orbment crashed, report was written to ");
+   write_str(STDERR_FILENO, recorder.path);
+   write_str(STDERR_FILENO, "\n");
+}
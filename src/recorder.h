@@ -0,0 +1,34 @@
+#ifndef __orbment_recorder_h__
+#define __orbment_recorder_h__
+
+#include <orbment/plugin.h>
+#include <stdint.h>
+
+/**
+ * Flight recorder of the last hook dispatches.
+ * Always on, the ring is written to a crash report when orbment receives a fatal signal.
+ */
+
+enum {
+   RECORDER_ENTRIES = 256, // must be power of two
+};
+
+/**
+ * Records start of a hook call, time is CLOCK_MONOTONIC in nanoseconds.
+ * Returns sequence number for recorder_end.
+ */
+uint64_t recorder_begin(uint8_t hook_type, plugin_h owner, uintptr_t handle, uint64_t time);
+
+/**
+ * Marks the hook call returned, time is 0 if not measured.
+ * Returns duration of the call, 0 if not measured or the entry was already overwritten.
+ */
+uint64_t recorder_end(uint64_t sequence, uint64_t time);
+
+/** Prepares crash report path and unwinder, call early at startup. */
+void recorder_setup(void);
+
+/** async-signal-safe, writes the crash report file and tells where on stderr. */
+void recorder_write_crash_report(int signal);
+
+#endif /* __orbment_recorder_h__ */
@@ -3,7 +3,9 @@
 #include <signal.h>
 #include <wlc/wlc.h>
 #include "plugin.h"
+#include "hooks.h"
 #include "log.h"
+#include "recorder.h"
 
 #if defined(__linux__) && defined(__GNUC__)
 #  include <fenv.h>
@@ -15,14 +17,23 @@ int feenableexcept(int excepts);
 #  include <xmmintrin.h>
 #endif
 
+static void
+crash(int signal)
+{
+   log_flush_crash();
+   recorder_write_crash_report(signal);
+
+   /* handler was reset by SA_RESETHAND, let the default action dump core */
+   raise(signal);
+}
+
 #ifndef NDEBUG
 
 static void
 fpehandler(int signal)
 {
-   (void)signal;
    plog(0, PLOG_ERROR, "SIGFPE signal received");
-   abort();
+   crash(signal);
 }
 
 static void
@@ -47,16 +58,6 @@ fpesetup(struct sigaction *action)
 #endif
 }
 
-static void
-backtrace(int signal)
-{
-   (void)signal;
-   log_backtrace();
-
-   /* SIGABRT || SIGSEGV */
-   exit(EXIT_FAILURE);
-}
-
 #endif /* NDEBUG */
 
 static void
@@ -76,17 +77,54 @@ signals_setup_debug(void)
 {
 #ifndef NDEBUG
    {
+      /* replaces the crash handler of SIGFPE, fpehandler still writes the crash report */
       struct sigaction action = {
-         .sa_handler = backtrace
+         .sa_handler = SIG_DFL,
+         .sa_flags = SA_RESETHAND | SA_ONSTACK,
       };
 
-      sigaction(SIGABRT, &action, NULL);
-      sigaction(SIGSEGV, &action, NULL);
       fpesetup(&action);
    }
 #endif
 }
 
+void
+signals_setup_crash(void)
+{
+   recorder_setup();
+
+   {
+      /* own stack, so stack overflows can be reported too */
+      static uint8_t stack[64 * 1024];
+      stack_t ss = {
+         .ss_sp = stack,
+         .ss_size = sizeof(stack),
+      };
+
+      sigaltstack(&ss, NULL);
+   }
+
+   {
+      struct sigaction action = {
+         .sa_handler = crash,
+         .sa_flags = SA_RESETHAND | SA_ONSTACK,
+      };
+
+      sigaction(SIGABRT, &action, NULL);
+      sigaction(SIGSEGV, &action, NULL);
+      sigaction(SIGBUS, &action, NULL);
+      sigaction(SIGILL, &action, NULL);
+      sigaction(SIGFPE, &action, NULL);
+   }
+}
+
+static void
+sigusr1(int signal)
+{
+   (void)signal;
+   hooks_request_profile_dump();
+}
+
 void
 signals_setup(void)
 {
@@ -108,4 +146,13 @@ signals_setup(void)
       sigaction(SIGTERM, &action, NULL);
       sigaction(SIGINT, &action, NULL);
    }
+
+   {
+      struct sigaction action = {
+         .sa_handler = sigusr1,
+      };
+
+      // dump hook latencies, see --profile-hooks
+      sigaction(SIGUSR1, &action, NULL);
+   }
 }
@@ -3,5 +3,6 @@
 
 void signals_setup(void);
 void signals_setup_debug(void);
+void signals_setup_crash(void);
 
 #endif /* __orbment_signals_h__ */